@@ -0,0 +1,147 @@
+/* affinity.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+
+/* CPUs the shell may run on, and the last one given by affinity_next() */
+static cpu_set_t shell_cpus;
+static int last_cpu = -1;
+
+/* Parse a CPU list like 0-3,8 into set, false (errno EINVAL) if it is
+ * invalid */
+static bool parse_cpus(const char* list, cpu_set_t* set) {
+    const char* s = list;
+    char* end;
+    long first, last;
+
+    CPU_ZERO(set);
+    errno = EINVAL;
+    while (*s) {
+        if (!isdigit((unsigned char) *s)) {
+            return false;
+        }
+        first = last = strtol(s, &end, 10);
+        if (*end == '-') {
+            if (!isdigit((unsigned char) end[1])) {
+                return false;
+            }
+            last = strtol(end + 1, &end, 10);
+        }
+        if (last < first || last >= CPU_SETSIZE || (*end && *end != ',')) {
+            return false;
+        }
+        for (; first <= last; first++) {
+            CPU_SET(first, set);
+        }
+        s = *end ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/* A single CPU as a CPU list */
+static char* cpu_list(int cpu) {
+    char* list = malloc(16);
+    sprintf(list, "%d", cpu);
+    return list;
+}
+
+void affinity_init() {
+    if (sched_getaffinity(0, sizeof(shell_cpus), &shell_cpus) < 0) {
+        CPU_ZERO(&shell_cpus);
+    }
+}
+
+bool affinity_valid(const char* list) {
+    cpu_set_t set, allowed;
+
+    if (!parse_cpus(list, &set)) {
+        return false;
+    }
+    if (CPU_COUNT(&shell_cpus) == 0) {
+        return true; /* unknown, sched_setaffinity() tells */
+    }
+    CPU_AND(&allowed, &set, &shell_cpus);
+    return CPU_EQUAL(&allowed, &set);
+}
+
+char* affinity_node(int node) {
+    char path[64], list[1024];
+    cpu_set_t set;
+    FILE* file;
+    bool found;
+
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+    file = node >= 0 ? fopen(path, "re") : NULL;
+    if (!file) {
+        return NULL;
+    }
+    found = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    list[strcspn(list, "\n")] = '\0';
+    return found && parse_cpus(list, &set) ? strdup(list) : NULL;
+}
+
+char* affinity_next() {
+    int cpu;
+
+    if (CPU_COUNT(&shell_cpus) == 0) {
+        return NULL;
+    }
+    for (cpu = last_cpu + 1;; cpu++) {
+        if (cpu >= CPU_SETSIZE) {
+            cpu = 0;
+        }
+        if (CPU_ISSET(cpu, &shell_cpus)) {
+            last_cpu = cpu;
+            return cpu_list(cpu);
+        }
+    }
+}
+
+char* affinity_nth(const char* list, size_t n) {
+    cpu_set_t set;
+    int cpu;
+
+    if (!parse_cpus(list, &set)) {
+        return NULL;
+    }
+    n %= (size_t) CPU_COUNT(&set);
+    for (cpu = 0; !CPU_ISSET(cpu, &set) || n-- > 0; cpu++);
+    return cpu_list(cpu);
+}
+
+bool affinity_pin(const char* list) {
+    cpu_set_t set;
+    return parse_cpus(list, &set) && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void affinity_unpin() {
+    if (CPU_COUNT(&shell_cpus) > 0) {
+        sched_setaffinity(0, sizeof(shell_cpus), &shell_cpus);
+    }
+}
@@ -0,0 +1,55 @@
+/* affinity.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_AFFINITY_H
+#define IMP_AFFINITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shell variable of the placement of background jobs run without pin:
+ * "auto" pins each one to the next CPU of the shell, in round-robin */
+#define AFFINITY_VAR "ROYALDUTCH_AFFINITY"
+
+/* Remember the CPUs the shell may run on */
+void affinity_init();
+
+/* True if list is a CPU list like 0-3,8 naming at least one CPU, all of
+ * them CPUs the shell may run on */
+bool affinity_valid(const char* list);
+
+/* CPU list of NUMA node (malloc'd), NULL if there is no such node */
+char* affinity_node(int node);
+
+/* The next CPU of the shell in round-robin, as a CPU list (malloc'd),
+ * NULL if they are unknown */
+char* affinity_next();
+
+/* The CPU n of list, counting over again past its end, as a CPU list
+ * (malloc'd) */
+char* affinity_nth(const char* list, size_t n);
+
+/* Pin the calling process to the CPUs of list, false with errno set if
+ * it could not be */
+bool affinity_pin(const char* list);
+
+/* Move the calling process back to the CPUs of affinity_init() */
+void affinity_unpin();
+
+#endif
@@ -0,0 +1,127 @@
+/* arena.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "debug.h"
+
+/* Every allocation is rounded up to this. */
+#define ARENA_ALIGN (2 * sizeof (void*))
+
+#define block_data(block) ((char *) (block) + ARENA_HEADER)
+#define ARENA_HEADER ((sizeof (arena_block_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static arena_block_t *new_block (size_t size)
+{
+  arena_block_t *block;
+
+  block = malloc (ARENA_HEADER + size);
+  sysfault (!block, NULL);
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+arena_t *new_arena (void)
+{
+  arena_t *arena;
+
+  arena = malloc (sizeof (arena_t));
+  sysfault (!arena, NULL);
+  arena->first = arena->current = new_block (ARENA_BLOCK_SIZE);
+  if (!arena->first)
+    {
+      free (arena);
+      return NULL;
+    }
+  return arena;
+}
+
+void release_arena (arena_t *arena)
+{
+  arena_block_t *block, *next;
+
+  for (block = arena->first; block; block = next)
+    {
+      next = block->next;
+      free (block);
+    }
+  free (arena);
+}
+
+void *arena_alloc (arena_t *arena, size_t size)
+{
+  arena_block_t *block = arena->current;
+  void *p;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  /* Move on to the next kept block, or chain a new one, until it fits. */
+  while (block->used + size > block->size)
+    {
+      if (!block->next || block->next->size < size)
+	{
+	  arena_block_t *fresh;
+	  fresh = new_block (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+	  if (!fresh)
+	    return NULL;
+	  fresh->next = block->next;
+	  block->next = fresh;
+	}
+      block = block->next;
+      block->used = 0;
+    }
+
+  arena->current = block;
+  p = block_data (block) + block->used;
+  block->used += size;
+  return p;
+}
+
+void *arena_calloc (arena_t *arena, size_t count, size_t size)
+{
+  void *p;
+
+  p = arena_alloc (arena, count * size);
+  if (p)
+    memset (p, 0, count * size);
+  return p;
+}
+
+char *arena_strndup (arena_t *arena, const char *str, size_t length)
+{
+  char *p;
+
+  p = arena_alloc (arena, length + 1);
+  if (p)
+    {
+      memcpy (p, str, length);
+      p[length] = '\0';
+    }
+  return p;
+}
+
+void arena_reset (arena_t *arena)
+{
+  arena->current = arena->first;
+  arena->first->used = 0;
+}
@@ -0,0 +1,64 @@
+/* arena.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_ARENA_H
+#define IMP_ARENA_H
+
+#include <stddef.h>
+
+/* Default size of an arena block, large enough for any usual command line */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* A block of arena memory, the data follows the header */
+typedef struct arena_block_t
+{
+  struct arena_block_t *next;	/* Next block in the chain. */
+  size_t size;			/* Usable bytes in this block. */
+  size_t used;			/* Bytes handed out so far. */
+} arena_block_t;
+
+/* Bump allocator: memory is handed out sequentially and only
+   released all at once by arena_reset() or release_arena(). Blocks are
+   kept across resets, so a reused arena does no malloc at all once it
+   has grown to the size of the largest command line seen. */
+typedef struct arena_t
+{
+  arena_block_t *first;		/* First block of the chain. */
+  arena_block_t *current;	/* Block allocations come from. */
+} arena_t;
+
+/* Return a new empty arena, or NULL on error. */
+arena_t *new_arena (void);
+
+/* Release the arena and all its blocks. */
+void release_arena (arena_t *arena);
+
+/* Allocate size bytes (suitably aligned) from the arena, or NULL on error. */
+void *arena_alloc (arena_t *arena, size_t size);
+
+/* Like arena_alloc() but the memory is zeroed. */
+void *arena_calloc (arena_t *arena, size_t count, size_t size);
+
+/* Copy length bytes of str into the arena and terminate them with '\0'. */
+char *arena_strndup (arena_t *arena, const char *str, size_t length);
+
+/* Make all the arena memory available again, keeping its blocks. */
+void arena_reset (arena_t *arena);
+
+#endif	/* IMP_ARENA_H */
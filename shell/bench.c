@@ -0,0 +1,346 @@
+/* bench.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Microbenchmarks of the shell internals, run by `make bench`.
+ *
+ * Every benchmark times single operations and prints one CSV row with
+ * the distribution of the samples, in nanoseconds:
+ *
+ *   benchmark,param,samples,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,ops_per_sec
+ *
+ * usage: royaldutch-bench [-n scale] [shell]
+ *   -n scale  multiply the number of samples (default 1)
+ *   shell     royaldutch binary for the end-to-end benchmark (default ./royaldutch)
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "royaldutch.h"
+#include "cmdhash.h"
+#include "vars.h"
+#include "zygote.h"
+
+/* Collected samples of one benchmark */
+typedef struct samples {
+    uint64_t* ns;
+    size_t count, size;
+} samples;
+
+static size_t scale = 1;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static void samples_init(samples* s, size_t size) {
+    s->ns = malloc(size * sizeof(*s->ns));
+    s->count = 0;
+    s->size = size;
+}
+
+static void samples_add(samples* s, uint64_t ns) {
+    if (s->count < s->size) {
+        s->ns[s->count++] = ns;
+    }
+}
+
+static int compare_ns(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Print the CSV row of a benchmark and release its samples */
+static void report(const char* name, const char* param, samples* s) {
+    uint64_t sum = 0;
+    double mean;
+    size_t i;
+
+    if (s->count == 0) {
+        fprintf(stderr, "%s(%s): no samples\n", name, param);
+        free(s->ns);
+        return;
+    }
+
+    qsort(s->ns, s->count, sizeof(*s->ns), compare_ns);
+    for (i = 0; i < s->count; i++) {
+        sum += s->ns[i];
+    }
+    mean = (double) sum / s->count;
+
+#define PERCENTILE(p) s->ns[(s->count - 1) * (p) / 100]
+    printf("%s,%s,%zu,%lu,%lu,%lu,%lu,%lu,%.0f,%.0f\n", name, param, s->count,
+           (unsigned long) s->ns[0], (unsigned long) PERCENTILE(50), (unsigned long) PERCENTILE(90),
+           (unsigned long) PERCENTILE(99), (unsigned long) s->ns[s->count - 1],
+           mean, mean > 0 ? 1e9 / mean : 0.0);
+#undef PERCENTILE
+    fflush(stdout);
+    free(s->ns);
+}
+
+/* Command line of a pipeline of n /bin/true (not the builtin, that is
+ * run without exec) */
+static char* pipeline_line(int n) {
+    char* line = malloc(n * sizeof("/bin/true | "));
+    char* p = line;
+    int i;
+    for (i = 0; i < n; i++) {
+        p = stpcpy(p, i ? " | /bin/true" : "/bin/true");
+    }
+    return line;
+}
+
+/* Parse line into a pipeline allocated from line_arena */
+static pipeline_t* parse(char* line) {
+    buffer_t buffer;
+    pipeline_t* pipeline;
+
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.buffer = line;
+    buffer.length = (int) strlen(line);
+
+    arena_reset(line_arena);
+    pipeline = new_pipeline(line_arena);
+    if (parse_command_line(&buffer, pipeline) || pipeline->ncommands == 0) {
+        fprintf(stderr, "bench: cannot parse \"%s\"\n", line);
+        exit(EXIT_FAILURE);
+    }
+    return pipeline;
+}
+
+static void bench_parse(const char* param, char* line, size_t count) {
+    samples s;
+    buffer_t buffer;
+    pipeline_t* pipeline;
+    size_t i;
+
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.buffer = line;
+    buffer.length = (int) strlen(line);
+
+    samples_init(&s, count);
+    for (i = 0; i < count; i++) {
+        uint64_t start;
+        arena_reset(line_arena);
+        pipeline = new_pipeline(line_arena);
+        start = now_ns();
+        parse_command_line(&buffer, pipeline);
+        samples_add(&s, now_ns() - start);
+    }
+    report("parse_command_line", param, &s);
+}
+
+static void bench_job_from_pipeline(const char* param, char* line, size_t count) {
+    samples s;
+    pipeline_t* pipeline = parse(line);
+    size_t i;
+
+    samples_init(&s, count);
+    for (i = 0; i < count; i++) {
+        uint64_t start = now_ns();
+        job* j = job_from_pipeline(pipeline);
+        samples_add(&s, now_ns() - start);
+        release_job(j);
+    }
+    report("job_from_pipeline", param, &s);
+}
+
+/* Time launch_job() alone, the processes are reaped afterwards */
+static void bench_launch_job(const char* name, int stages, size_t count) {
+    char param[32];
+    char* line = pipeline_line(stages);
+    pipeline_t* pipeline = parse(line);
+    samples s;
+    size_t i;
+
+    samples_init(&s, count);
+    for (i = 0; i < count; i++) {
+        job* j = job_from_pipeline(pipeline);
+        uint64_t start = now_ns();
+        int k;
+
+        launch_job(j);
+        samples_add(&s, now_ns() - start);
+
+        for (k = 0; k < j->number_procs; k++) {
+            if (j->procs[k].pid > 0) {
+                waitpid(j->procs[k].pid, NULL, 0);
+            }
+        }
+        release_job(j);
+    }
+    sprintf(param, "%d_stages", stages);
+    report(name, param, &s);
+    free(line);
+}
+
+/* Time the lookup of a status change among njobs jobs of 2 processes */
+static void bench_update_status(size_t njobs) {
+    char param[32];
+    char line[] = "true | true";
+    pipeline_t* pipeline = parse(line);
+    size_t i, count = njobs < 10000 * scale ? njobs : 10000 * scale;
+    int pid = 1;
+    samples s;
+
+    for (i = 0; i < njobs; i++) {
+        job* j = job_from_pipeline(pipeline);
+        j->pgid = pid;
+        j->procs[0].pid = pid++;
+        j->procs[1].pid = pid++;
+        put_job(j);
+    }
+
+    /* stop every sampled process once, spread over the whole table */
+    samples_init(&s, count);
+    for (i = 0; i < count; i++) {
+        int target = 1 + (int) (i * (njobs * 2 / count));
+        uint64_t start = now_ns();
+        jobs_update_status(target, W_STOPCODE(SIGTSTP), NULL);
+        samples_add(&s, now_ns() - start);
+    }
+    release_jobs();
+
+    sprintf(param, "%zu_jobs", njobs);
+    report("jobs_update_status", param, &s);
+}
+
+/* Run ncommands times command through the stdin of the shell, one sample is
+ * the mean time of a command in one run (1e9 / mean is commands per second) */
+static void bench_stdin(const char* shell, const char* name, const char* command, size_t ncommands, size_t runs) {
+    char path[] = "/tmp/royaldutch-bench.XXXXXX";
+    char param[32];
+    samples s;
+    size_t i;
+    int fd = mkstemp(path);
+    FILE* script;
+
+    if (fd < 0) {
+        perror("mkstemp");
+        return;
+    }
+    unlink(path);
+    script = fdopen(fd, "w+");
+    for (i = 0; i < ncommands; i++) {
+        fprintf(script, "%s\n", command);
+    }
+    fflush(script);
+
+    samples_init(&s, runs);
+    for (i = 0; i < runs; i++) {
+        uint64_t start = now_ns();
+        int status;
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            lseek(fd, 0, SEEK_SET);
+            dup2(fd, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            execl(shell, shell, (char*) NULL);
+            perror(shell);
+            _exit(127);
+        }
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "bench: %s failed\n", shell);
+            break;
+        }
+        samples_add(&s, (now_ns() - start) / ncommands);
+    }
+    fclose(script);
+
+    sprintf(param, "%zu_commands", ncommands);
+    report(name, param, &s);
+}
+
+int main(int argc, char** argv) {
+    const char* shell = "./royaldutch";
+    char simple[] = "ls -l /tmp";
+    char complex[] = "grep -v '^#' < /dev/null | sort -k2 \"-t \" | uniq -c >> /dev/null 2> /dev/null &";
+    char* words;
+    size_t i;
+    int opt;
+    bool zygote;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n' && atoi(optarg) > 0) {
+            scale = (size_t) atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-n scale] [shell]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        shell = argv[optind];
+    }
+
+    /* a 1000 word command line */
+    words = malloc(1000 * sizeof("word "));
+    for (i = 0; i < 1000; i++) {
+        memcpy(words + i * 5, "word ", 5);
+    }
+    words[1000 * 5 - 1] = '\0';
+
+    /* forked while the process is small, as the shell does */
+    zygote = zygote_start();
+
+    line_arena = new_arena();
+    vars_init();
+
+    printf("benchmark,param,samples,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,ops_per_sec\n");
+
+    bench_parse("simple", simple, 100000 * scale);
+    bench_parse("complex", complex, 100000 * scale);
+    bench_parse("1000_words", words, 10000 * scale);
+
+    bench_job_from_pipeline("simple", simple, 100000 * scale);
+    bench_job_from_pipeline("complex", complex, 100000 * scale);
+    bench_job_from_pipeline("1000_words", words, 10000 * scale);
+
+    if (zygote) {
+        bench_launch_job("launch_job_zygote", 1, 500 * scale);
+        bench_launch_job("launch_job_zygote", 8, 100 * scale);
+        zygote_stop();
+    }
+    bench_launch_job("launch_job", 1, 500 * scale);
+    bench_launch_job("launch_job", 8, 100 * scale);
+    bench_launch_job("launch_job", 64, 20 * scale);
+
+    bench_update_status(100);
+    bench_update_status(10000);
+    bench_update_status(100000);
+
+    bench_stdin(shell, "stdin_builtin", "true", 1000, 10 * scale);
+    bench_stdin(shell, "stdin_exec", "/bin/true", 1000, 10 * scale);
+
+    cmdhash_release();
+    vars_release();
+    release_arena(line_arena);
+    free(words);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,734 @@
+/* builtin.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.h"
+#include "royaldutch.h"
+#include "vars.h"
+
+/* Registration table, help prints it in this order */
+static const builtin builtins[] = {
+    {"cd", builtin_cd, builtin_help_cd},
+    {"fg", builtin_fg, builtin_help_fg},
+    {"bg", builtin_bg, builtin_help_bg},
+    {"jobs", builtin_jobs, builtin_help_jobs},
+    {"hash", builtin_hash, builtin_help_hash},
+    {"parallel", builtin_parallel, builtin_help_parallel},
+    {"wait", builtin_wait, builtin_help_wait},
+    {"echo", builtin_echo, builtin_help_echo},
+    {"printf", builtin_printf, builtin_help_printf},
+    {"pwd", builtin_pwd, builtin_help_pwd},
+    {"true", builtin_true, builtin_help_true},
+    {"false", builtin_false, NULL},
+    {"test", builtin_test, builtin_help_test},
+    {"[", builtin_test, NULL},
+    {"read", builtin_read, builtin_help_read},
+    {"export", builtin_export, builtin_help_export},
+    {"unset", builtin_unset, builtin_help_unset},
+    {"help", builtin_help, builtin_help_help},
+    {"exit", builtin_exit, builtin_help_exit},
+};
+
+#define NBUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+/* Slots of the perfect hash, a power of two larger than NBUILTINS */
+#define BUILTIN_SLOTS 64
+
+/* Seeds tried before falling back to a linear scan of the table */
+#define BUILTIN_SEED_TRIES (1ul << 20)
+
+static signed char builtin_slots[BUILTIN_SLOTS]; /* Index in builtins, -1 if free */
+static unsigned long builtin_seed;               /* 0 until the slots are built */
+static bool builtin_linear;                      /* No seed was found, scan the table */
+
+/* FNV-1a of name mixed with seed. The low bits of FNV only depend on the
+ * low bits of its input, so the high bits are folded in after the seed. */
+static unsigned long seeded_hash(const char* name, unsigned long seed) {
+    unsigned long hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    hash = ((hash ^ seed) * 2654435761u) & 0xffffffffu;
+    return hash ^ (hash >> 16);
+}
+
+/* Look for a seed that sends every builtin name to its own slot */
+static void build_slots() {
+    unsigned long seed;
+    size_t i;
+
+    for (seed = 1; seed <= BUILTIN_SEED_TRIES; seed++) {
+        memset(builtin_slots, -1, sizeof(builtin_slots));
+        for (i = 0; i < NBUILTINS; i++) {
+            signed char* slot = &builtin_slots[seeded_hash(builtins[i].name, seed) & (BUILTIN_SLOTS - 1)];
+            if (*slot >= 0) {
+                break;
+            }
+            *slot = (signed char) i;
+        }
+        if (i == NBUILTINS) {
+            builtin_seed = seed;
+            return;
+        }
+    }
+    builtin_seed = seed;
+    builtin_linear = true;
+}
+
+const builtin* find_builtin(const char* name) {
+    int i;
+
+    if (!builtin_seed) {
+        build_slots();
+    }
+    if (builtin_linear) {
+        for (i = 0; i < NBUILTINS && strcmp(builtins[i].name, name) != 0; i++);
+        return i < NBUILTINS ? &builtins[i] : NULL;
+    }
+    i = builtin_slots[seeded_hash(name, builtin_seed) & (BUILTIN_SLOTS - 1)];
+    return i >= 0 && strcmp(builtins[i].name, name) == 0 ? &builtins[i] : NULL;
+}
+
+int run_builtin(const builtin* b, process* proc, int in, int out, int err) {
+    int fds[3], saved[3];
+    int i, status;
+
+    fds[STDIN_FILENO] = in;
+    fds[STDOUT_FILENO] = out;
+    fds[STDERR_FILENO] = err;
+
+    /* redirect the shell standard descriptors for the duration */
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < 3; i++) {
+        saved[i] = -1;
+        if (fds[i] != i) {
+            saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+            dup2(fds[i], i);
+        }
+    }
+
+    status = b->run(proc);
+
+    /* the output must be out before the next process writes its own */
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < 3; i++) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+
+    return status & 0xff;
+}
+
+/**************************************************
+ * Built-in functions
+ **************************************************/
+int builtin_help(process* proc) {
+    size_t i;
+    for (i = 0; i < NBUILTINS; i++) {
+        if (builtins[i].help) {
+            builtins[i].help();
+        }
+    }
+    builtin_help_time();
+    builtin_help_timeout();
+    builtin_help_limit();
+    builtin_help_pin();
+    return 0;
+}
+
+/* Print the character of the escape sequence at s (after the backslash),
+ * return the end of the sequence. \c sets stop. */
+static const char* put_escape(const char* s, bool* stop) {
+    int c = 0, n;
+
+    switch (*s) {
+        case 'a': putchar('\a'); break;
+        case 'b': putchar('\b'); break;
+        case 'f': putchar('\f'); break;
+        case 'n': putchar('\n'); break;
+        case 'r': putchar('\r'); break;
+        case 't': putchar('\t'); break;
+        case 'v': putchar('\v'); break;
+        case '\\': putchar('\\'); break;
+        case 'c': *stop = true; break;
+        case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7':
+            /* \0nnn and \nnn: up to three octal digits after the 0 */
+            if (*s == '0') {
+                s++;
+            }
+            for (n = 0; n < 3 && *s >= '0' && *s <= '7'; n++, s++) {
+                c = c * 8 + (*s - '0');
+            }
+            putchar(c);
+            return s;
+        case '\0':
+            putchar('\\');
+            return s;
+        default:
+            putchar('\\');
+            putchar(*s);
+    }
+    return s + 1;
+}
+
+/* Print s interpreting its escapes, false if \c stopped the output */
+static bool put_escaped(const char* s) {
+    bool stop = false;
+    while (*s && !stop) {
+        if (*s == '\\') {
+            s = put_escape(s + 1, &stop);
+        } else {
+            putchar(*s++);
+        }
+    }
+    return !stop;
+}
+
+int builtin_echo(process* proc) {
+    bool newline = true, escapes = false;
+    size_t i, first;
+
+    /* options, until an argument that isn't only made of them */
+    for (first = 1; first < proc->argc && proc->argv[first][0] == '-' && proc->argv[first][1]; first++) {
+        const char* opt = proc->argv[first] + 1;
+        if (strspn(opt, "neE") != strlen(opt)) {
+            break;
+        }
+        for (; *opt; opt++) {
+            if (*opt == 'n') {
+                newline = false;
+            } else {
+                escapes = *opt == 'e';
+            }
+        }
+    }
+
+    for (i = first; i < proc->argc; i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        if (!escapes) {
+            fputs(proc->argv[i], stdout);
+        } else if (!put_escaped(proc->argv[i])) {
+            return 0;
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/* Numeric argument of printf, sets *ret to 1 if it isn't a number */
+static long printf_number(const char* arg, bool is_signed, int* ret) {
+    char* end;
+    long value;
+
+    if (!arg || !*arg) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        return (unsigned char) arg[1]; /* 'c: the character code */
+    }
+    errno = 0;
+    value = is_signed ? strtol(arg, &end, 0) : (long) strtoul(arg, &end, 0);
+    if (*end || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *ret = 1;
+    }
+    return value;
+}
+
+int builtin_printf(process* proc) {
+    char** args, ** end = proc->argv + proc->argc, ** consumed;
+    const char* format, * f;
+    char spec[32];
+    bool stop = false;
+    int ret = 0;
+
+    if (proc->argc < 2) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    format = proc->argv[1];
+    args = proc->argv + 2;
+
+    /* the format is reused as long as it consumes arguments */
+    do {
+        consumed = args;
+        for (f = format; *f && !stop;) {
+            size_t n;
+            const char* arg;
+
+            if (*f == '\\') {
+                f = put_escape(f + 1, &stop);
+                continue;
+            }
+            if (*f != '%') {
+                putchar(*f++);
+                continue;
+            }
+            if (f[1] == '%') {
+                putchar('%');
+                f += 2;
+                continue;
+            }
+
+            /* %[flags][width][.precision]conversion */
+            n = 1 + strspn(f + 1, "-+ #0");
+            n += strspn(f + n, "0123456789");
+            if (f[n] == '.') {
+                n += 1 + strspn(f + n + 1, "0123456789");
+            }
+            if (n + 3 > sizeof(spec)) {
+                fprintf(stderr, "printf: %s: invalid format\n", format);
+                return 1;
+            }
+            memcpy(spec, f, n);
+            arg = args < end ? *args++ : NULL;
+
+            switch (f[n]) {
+                case 'd': case 'i':
+                    strcpy(spec + n, "ld");
+                    printf(spec, printf_number(arg, true, &ret));
+                    break;
+                case 'u': case 'o': case 'x': case 'X':
+                    spec[n] = 'l';
+                    spec[n + 1] = f[n];
+                    spec[n + 2] = '\0';
+                    printf(spec, (unsigned long) printf_number(arg, false, &ret));
+                    break;
+                case 'c':
+                    strcpy(spec + n, "c");
+                    if (arg && *arg) {
+                        printf(spec, *arg);
+                    }
+                    break;
+                case 's':
+                    strcpy(spec + n, "s");
+                    printf(spec, arg ? arg : "");
+                    break;
+                case 'b':
+                    stop = arg && !put_escaped(arg);
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid directive\n", f[n]);
+                    return 1;
+            }
+            f += n + 1;
+        }
+    } while (!stop && args < end && args > consumed);
+
+    return ret;
+}
+
+int builtin_pwd(process* proc) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        print_error("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+int builtin_true(process* proc) {
+    return 0;
+}
+
+int builtin_false(process* proc) {
+    return 1;
+}
+
+/* Recursive descent over the test arguments */
+typedef struct {
+    char** argv;
+    size_t argc, pos;
+    bool error;                 /* Syntax error */
+    bool bad_number;            /* Already reported */
+} test_state;
+
+static bool test_or(test_state* t);
+
+static bool test_unary(char op, const char* arg) {
+    struct stat st;
+
+    switch (op) {
+        case 'n': return *arg != '\0';
+        case 'z': return *arg == '\0';
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'h': case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+    }
+    return false;
+}
+
+static bool is_unary(const char* op) {
+    return op[0] == '-' && op[1] && !op[2] && strchr("nzefdshLrwx", op[1]);
+}
+
+static bool is_binary(const char* op) {
+    static const char* ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+    const char** o;
+    for (o = ops; *o; o++) {
+        if (strcmp(*o, op) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static long test_number(test_state* t, const char* arg) {
+    char* end;
+    long value = strtol(arg, &end, 10);
+    if (!*arg || *end) {
+        fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        t->bad_number = true;
+    }
+    return value;
+}
+
+static bool test_binary(test_state* t, const char* left, const char* op, const char* right) {
+    long a, b;
+
+    if (op[0] != '-') {
+        int cmp = strcmp(left, right);
+        switch (op[0]) {
+            case '=': return cmp == 0;
+            case '!': return cmp != 0;
+            case '<': return cmp < 0;
+            default: return cmp > 0;
+        }
+    }
+
+    a = test_number(t, left);
+    b = test_number(t, right);
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    if (strcmp(op, "-le") == 0) return a <= b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;
+}
+
+static bool test_primary(test_state* t) {
+    char** argv = t->argv + t->pos;
+    size_t left = t->argc - t->pos;
+    bool result;
+
+    if (left == 0) {
+        t->error = true;
+        return false;
+    }
+    if (left >= 3 && is_binary(argv[1])) {
+        t->pos += 3;
+        return test_binary(t, argv[0], argv[1], argv[2]);
+    }
+    if (left >= 2 && is_unary(argv[0])) {
+        t->pos += 2;
+        return test_unary(argv[0][1], argv[1]);
+    }
+    if (strcmp(argv[0], "(") == 0 && left >= 2) {
+        t->pos++;
+        result = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")") != 0) {
+            t->error = true;
+        }
+        t->pos++;
+        return result;
+    }
+    t->pos++;
+    return argv[0][0] != '\0';
+}
+
+static bool test_not(test_state* t) {
+    if (t->pos < t->argc && strcmp(t->argv[t->pos], "!") == 0 && t->pos + 1 < t->argc) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool test_and(test_state* t) {
+    bool result = test_not(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0) {
+        t->pos++;
+        result = test_not(t) && result;
+    }
+    return result;
+}
+
+static bool test_or(test_state* t) {
+    bool result = test_and(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0) {
+        t->pos++;
+        result = test_and(t) || result;
+    }
+    return result;
+}
+
+int builtin_test(process* proc) {
+    test_state t;
+    bool result;
+
+    t.argv = proc->argv + 1;
+    t.argc = proc->argc - 1;
+    t.pos = 0;
+    t.error = false;
+    t.bad_number = false;
+
+    if (strcmp(proc->argv[0], "[") == 0) {
+        if (t.argc == 0 || strcmp(t.argv[t.argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ]\n");
+            return 2;
+        }
+        t.argc--;
+    }
+    if (t.argc == 0) {
+        return 1;
+    }
+
+    result = test_or(&t);
+    if (t.error || t.pos != t.argc) {
+        fprintf(stderr, "%s: syntax error\n", proc->argv[0]);
+        return 2;
+    }
+    if (t.bad_number) {
+        return 2;
+    }
+    return result ? 0 : 1;
+}
+
+#define IFS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+int builtin_read(process* proc) {
+    bool raw = proc->argc > 1 && strcmp(proc->argv[1], "-r") == 0;
+    char** names = proc->argv + (raw ? 2 : 1);
+    size_t nnames = proc->argc - (raw ? 2 : 1);
+    size_t length = 0, size = 128;
+    char* line = malloc(size), * field;
+    bool eof = false, escaped = false;
+    buffer_t* input = builtin_shell_input(proc);
+    char c;
+
+    /* one byte at a time: what follows the line is left to the next reader */
+    while (true) {
+        ssize_t n;
+        if (input) {
+            int next = command_line_getc(input);
+            n = next < 0 ? 0 : 1;
+            c = (char) next;
+        } else {
+            n = read(STDIN_FILENO, &c, 1);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            eof = true;
+            break;
+        }
+        if (escaped) {
+            escaped = false;
+            if (c == '\n') {
+                continue; /* line continuation */
+            }
+        } else if (c == '\\' && !raw) {
+            escaped = true;
+            continue;
+        } else if (c == '\n') {
+            break;
+        }
+        if (length + 1 >= size) {
+            size *= 2;
+            line = realloc(line, size);
+        }
+        line[length++] = c;
+    }
+    line[length] = '\0';
+
+    if (nnames == 0) {
+        var_set("REPLY", line);
+    } else {
+        /* one field per name, the last name takes the rest of the line */
+        field = line;
+        for (; nnames > 0; names++, nnames--) {
+            char* end;
+            while (IFS_BLANK(*field)) {
+                field++;
+            }
+            end = field;
+            if (nnames == 1) {
+                end += strlen(end);
+                while (end > field && IFS_BLANK(end[-1])) {
+                    end--;
+                }
+            } else {
+                while (*end && !IFS_BLANK(*end)) {
+                    end++;
+                }
+            }
+            c = *end;
+            *end = '\0';
+            if (!var_set(*names, field)) {
+                fprintf(stderr, "read: %s: not a valid identifier\n", *names);
+                eof = true;
+            }
+            *end = c;
+            field = end;
+        }
+    }
+
+    free(line);
+    return eof ? 1 : 0;
+}
+
+/* Order of the export listing */
+static int compare_names(const void* a, const void* b) {
+    return strcmp((*(hashtab_entry* const*) a)->key, (*(hashtab_entry* const*) b)->key);
+}
+
+static void collect_exported(hashtab_entry* entry, void* data) {
+    hashtab_entry*** next = data;
+    if (((shell_var*) entry->value)->exported) {
+        *(*next)++ = entry;
+    }
+}
+
+int builtin_export(process* proc) {
+    int status = 0;
+    size_t i;
+
+    if (proc->argc == 1 || (proc->argc == 2 && strcmp(proc->argv[1], "-p") == 0)) {
+        /* export NAME='value' lines, in name order, to be read back */
+        hashtab_entry** entries = malloc((vars_table->size + 1) * sizeof(*entries));
+        hashtab_entry** next = entries;
+        hashtab_entry** e;
+
+        hashtab_foreach(vars_table, collect_exported, &next);
+        qsort(entries, next - entries, sizeof(*entries), compare_names);
+        for (e = entries; e < next; e++) {
+            const char* v;
+            printf("export %s='", (*e)->key);
+            for (v = ((shell_var*) (*e)->value)->value; *v; v++) {
+                if (*v == '\'') {
+                    fputs("'\\''", stdout);
+                } else {
+                    putchar(*v);
+                }
+            }
+            printf("'\n");
+        }
+        free(entries);
+        return 0;
+    }
+
+    for (i = 1; i < proc->argc; i++) {
+        char* name = proc->argv[i];
+        char* value = strchr(name, '=');
+        bool valid;
+
+        if (value) {
+            *value = '\0';
+            valid = var_export(name, value + 1);
+            *value = '=';
+        } else {
+            valid = var_export(name, NULL);
+        }
+        if (!valid) {
+            fprintf(stderr, "export: %s: not a valid identifier\n", name);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int builtin_unset(process* proc) {
+    int status = 0;
+    size_t i;
+
+    for (i = 1; i < proc->argc; i++) {
+        if (!var_valid_name(proc->argv[i], strlen(proc->argv[i]))) {
+            fprintf(stderr, "unset: %s: not a valid identifier\n", proc->argv[i]);
+            status = 1;
+        } else {
+            var_unset(proc->argv[i]);
+        }
+    }
+    return status;
+}
+
+/***************************************************************
+ * User help functions
+ ***************************************************************/
+void builtin_help_help() {
+    printf("help\t\tDisplay this help.\n");
+}
+
+void builtin_help_echo() {
+    printf("echo [-neE] [arg...]\tWrite the arguments to the standard output.\n");
+}
+
+void builtin_help_printf() {
+    printf("printf format [arg...]\tWrite the arguments according to format.\n");
+}
+
+void builtin_help_pwd() {
+    printf("pwd\t\tPrint the working directory.\n");
+}
+
+void builtin_help_true() {
+    printf("true, false\tReturn a successful or unsuccessful status.\n");
+}
+
+void builtin_help_test() {
+    printf("test expr, [ expr ]\tEvaluate a conditional expression.\n");
+}
+
+void builtin_help_read() {
+    printf("read [-r] [name...]\tRead a line of input into variables (REPLY by default).\n");
+}
+
+void builtin_help_export() {
+    printf("export [name[=value]...]\tExport variables to the commands run, list them without names.\n");
+}
+
+void builtin_help_unset() {
+    printf("unset name...\tRemove variables.\n");
+}
@@ -0,0 +1,90 @@
+/* builtin.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_BUILTIN_TABLE_H
+#define IMP_BUILTIN_TABLE_H
+
+#include "job.h"
+
+/* Body of a builtin: run with the process arguments, its standard
+ * descriptors are the ones of the process. Return the exit status. */
+typedef int (*builtin_function)(process* proc);
+
+/* A command run by the shell itself, without exec. A lone foreground
+ * builtin runs in the shell process, in a pipeline or in background
+ * it runs in a forked child (see spawn_builtin()) */
+typedef struct builtin {
+    const char* name;           /* Command name */
+    builtin_function run;       /* What the command does */
+    void (*help)();             /* Print its help line, may be NULL */
+} builtin;
+
+/* Find the builtin called name, NULL if there is none. The registration
+ * table is looked up with a perfect hash: one hash and one strcmp. */
+const builtin* find_builtin(const char* name);
+
+/* Run a builtin in the shell process with in, out and err as its
+ * standard descriptors. Return the exit status. */
+int run_builtin(const builtin* b, process* proc, int in, int out, int err);
+
+/**************************************************
+ * Built-in commands that don't need the shell state
+ **************************************************/
+
+/** Print the help of every builtin */
+int builtin_help(process* proc);
+
+/** Print the arguments (-n: no newline, -e: interpret escapes) */
+int builtin_echo(process* proc);
+
+/** Print the arguments according to a format */
+int builtin_printf(process* proc);
+
+/** Print the working directory */
+int builtin_pwd(process* proc);
+
+/** Do nothing, successfully */
+int builtin_true(process* proc);
+
+/** Do nothing, unsuccessfully */
+int builtin_false(process* proc);
+
+/** Evaluate a conditional expression (test and [) */
+int builtin_test(process* proc);
+
+/** Read a line of stdin into shell variables */
+int builtin_read(process* proc);
+
+/** Export variables, or list the exported ones */
+int builtin_export(process* proc);
+
+/** Remove variables */
+int builtin_unset(process* proc);
+
+void builtin_help_help();
+void builtin_help_echo();
+void builtin_help_printf();
+void builtin_help_pwd();
+void builtin_help_true();
+void builtin_help_test();
+void builtin_help_read();
+void builtin_help_export();
+void builtin_help_unset();
+
+#endif
@@ -0,0 +1,206 @@
+/* cgroup.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+
+/* Directory of CGROUP_ENV, -1 when jobs get no cgroup */
+static int cgroup_root = -1;
+
+/* Job cgroups are named job-<shell pid>-<number>, several shells may
+ * share the same delegated cgroup */
+static pid_t cgroup_owner;
+static unsigned cgroup_next;
+
+/* Write text to the file name of directory dir, report failures */
+static bool write_file(int dir, const char* name, const char* text) {
+    int fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+    bool written = fd >= 0 && write(fd, text, strlen(text)) == (ssize_t) strlen(text);
+
+    if (!written) {
+        fprintf(stderr, "limit: %s: %s\n", name, strerror(errno));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return written;
+}
+
+/* Read the file name of directory dir into buffer (size bytes), false if
+ * it could not be read */
+static bool read_file(int dir, const char* name, char* buffer, size_t size) {
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    ssize_t n = fd >= 0 ? read(fd, buffer, size - 1) : -1;
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    buffer[n > 0 ? n : 0] = '\0';
+    return n > 0;
+}
+
+void cgroup_init() {
+    const char* path = getenv(CGROUP_ENV);
+    int fd;
+
+    if (!path || !*path) {
+        return;
+    }
+    cgroup_root = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup_root < 0) {
+        fprintf(stderr, "%s: %s: %s\n", CGROUP_ENV, path, strerror(errno));
+        return;
+    }
+    cgroup_owner = getpid();
+
+    /* each controller on its own, a missing one does not fail the others */
+    fd = openat(cgroup_root, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        (void) !write(fd, "+cpu", 4);
+        (void) !write(fd, "+memory", 7);
+        (void) !write(fd, "+pids", 5);
+        close(fd);
+    }
+}
+
+void cgroup_release() {
+    if (cgroup_root >= 0) {
+        close(cgroup_root);
+    }
+    cgroup_root = -1;
+}
+
+bool cgroup_enabled() {
+    return cgroup_root >= 0;
+}
+
+bool cgroup_cpu_valid(const char* cpu) {
+    char* end;
+    double percent;
+
+    if (strcmp(cpu, "max") == 0) {
+        return true;
+    }
+    percent = strtod(cpu, &end);
+    return end != cpu && (*end == '\0' || strcmp(end, "%") == 0) && percent > 0 && percent < 1e6;
+}
+
+int cgroup_create(unsigned* id, const char* cpu, const char* memory, const char* pids) {
+    char name[64], quota[64];
+    int cgroup;
+
+    if (cgroup_root < 0) {
+        return -1;
+    }
+    *id = cgroup_next++;
+    sprintf(name, "job-%ld-%u", (long) cgroup_owner, *id);
+    if (mkdirat(cgroup_root, name, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s: %s\n", CGROUP_ENV, name, strerror(errno));
+        return -1;
+    }
+    cgroup = openat(cgroup_root, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup < 0) {
+        unlinkat(cgroup_root, name, AT_REMOVEDIR);
+        return -1;
+    }
+
+    /* a percentage of one CPU, over the default 100ms period */
+    if (cpu && strcmp(cpu, "max") != 0) {
+        sprintf(quota, "%ld 100000", (long) (strtod(cpu, NULL) * 1000));
+        cpu = quota;
+    }
+    if ((cpu && !write_file(cgroup, "cpu.max", cpu))
+        || (memory && !write_file(cgroup, "memory.max", memory))
+        || (pids && !write_file(cgroup, "pids.max", pids))) {
+        cgroup_remove(cgroup, *id);
+        return -1;
+    }
+    return cgroup;
+}
+
+bool cgroup_attach(int cgroup, pid_t pid) {
+    char text[32];
+    int fd;
+    bool attached;
+
+    if (cgroup < 0) {
+        return false;
+    }
+    fd = openat(cgroup, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+    sprintf(text, "%ld", (long) pid);
+    attached = fd >= 0 && write(fd, text, strlen(text)) > 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return attached;
+}
+
+void cgroup_remove(int cgroup, unsigned id) {
+    char name[64];
+
+    if (cgroup < 0) {
+        return;
+    }
+    close(cgroup);
+    sprintf(name, "job-%ld-%u", (long) cgroup_owner, id);
+    unlinkat(cgroup_root, name, AT_REMOVEDIR);
+}
+
+void cgroup_print_usage(int cgroup, unsigned id, FILE* out) {
+    char text[1024];
+    const char* field;
+    double usage = 0, user = 0, system = 0, throttled = 0;
+
+    if (cgroup < 0) {
+        return;
+    }
+    fprintf(out, "cgroup job-%ld-%u:", (long) cgroup_owner, id);
+    if (read_file(cgroup, "memory.peak", text, sizeof(text))) {
+        fprintf(out, " memory.peak %.1fM,", strtod(text, NULL) / (1024 * 1024));
+    } else {
+        fprintf(out, " memory.peak -,");
+    }
+
+    /* cpu.stat lines are "<key> <value>", times in microseconds */
+    if (read_file(cgroup, "cpu.stat", text, sizeof(text))) {
+        if ((field = strstr(text, "usage_usec "))) {
+            usage = strtod(field + strlen("usage_usec "), NULL) / 1e6;
+        }
+        if ((field = strstr(text, "user_usec "))) {
+            user = strtod(field + strlen("user_usec "), NULL) / 1e6;
+        }
+        if ((field = strstr(text, "system_usec "))) {
+            system = strtod(field + strlen("system_usec "), NULL) / 1e6;
+        }
+        if ((field = strstr(text, "throttled_usec "))) {
+            throttled = strtod(field + strlen("throttled_usec "), NULL) / 1e6;
+        }
+        fprintf(out, " cpu %.3fs (user %.3fs, sys %.3fs), throttled %.3fs\n",
+                usage, user, system, throttled);
+    } else {
+        fprintf(out, " cpu -\n");
+    }
+}
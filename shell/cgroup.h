@@ -0,0 +1,64 @@
+/* cgroup.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_CGROUP_H
+#define IMP_CGROUP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Environment variable naming a delegated cgroup v2 directory (writable,
+ * and not the one the shell runs in): every job gets a cgroup of its own
+ * below it, for accounting and for the limits of the limit prefix */
+#define CGROUP_ENV "ROYALDUTCH_CGROUP"
+
+/* Open the directory of CGROUP_ENV, if set, and enable the cpu, memory
+ * and pids controllers for the job cgroups (best effort) */
+void cgroup_init();
+
+/* Close the directory of CGROUP_ENV */
+void cgroup_release();
+
+/* True when jobs get cgroups */
+bool cgroup_enabled();
+
+/* True if cpu is a limit the limit prefix takes: "max", or a percentage
+ * of one CPU like 50 or 250% */
+bool cgroup_cpu_valid(const char* cpu);
+
+/* Create the cgroup of a new job, with cpu.max, memory.max and pids.max
+ * set to cpu (a percentage, see cgroup_cpu_valid()), memory and pids,
+ * NULL to keep the parent's limits. Return the cgroup directory
+ * descriptor, or -1 if cgroups are off or it could not be created with
+ * every limit (reported); *id is the number naming it. */
+int cgroup_create(unsigned* id, const char* cpu, const char* memory, const char* pids);
+
+/* Move pid (0: the calling process) into the cgroup of descriptor cgroup,
+ * false with errno set if it could not be moved */
+bool cgroup_attach(int cgroup, pid_t pid);
+
+/* Close the cgroup descriptor and remove the cgroup of number id; it is
+ * left behind if processes outlived the job in it */
+void cgroup_remove(int cgroup, unsigned id);
+
+/* Print the peak memory and CPU time used by the processes of a cgroup */
+void cgroup_print_usage(int cgroup, unsigned id, FILE* out);
+
+#endif
@@ -0,0 +1,168 @@
+/* cmdhash.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmdhash.h"
+#include "tparse.h"
+#include "vars.h"
+
+hashtab* cmdhash_table;
+
+/* Copy of the PATH the cached entries were resolved against */
+static char* cached_path;
+
+static void release_entry(void* value) {
+    cmdhash_entry* entry = value;
+    free(entry->path);
+    free(entry);
+}
+
+static long monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec;
+}
+
+/* Drop the whole cache when PATH is not the one it was built for */
+static void check_path(const char* path) {
+    if (cached_path && strcmp(cached_path, path) == 0) {
+        return;
+    }
+    free(cached_path);
+    cached_path = stringdup(path);
+    if (cmdhash_table) {
+        hashtab_clear(cmdhash_table);
+    } else {
+        cmdhash_table = new_hashtab(release_entry);
+    }
+}
+
+/* Search every PATH directory for name, like execvp() does */
+static char* search_path(const char* name, const char* path) {
+    char candidate[PATH_MAX];
+    size_t namelen = strlen(name);
+    struct stat st;
+    int err = ENOENT;
+
+    while (true) {
+        const char* end = strchrnul(path, ':');
+        size_t dirlen = (size_t) (end - path);
+
+        if (dirlen + namelen + 2 <= sizeof(candidate)) {
+            if (dirlen == 0) {
+                candidate[dirlen++] = '.';  /* empty entry is the working directory */
+            } else {
+                memcpy(candidate, path, dirlen);
+            }
+            candidate[dirlen] = '/';
+            memcpy(candidate + dirlen + 1, name, namelen + 1);
+
+            if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode)) {
+                if (access(candidate, X_OK) == 0) {
+                    return stringdup(candidate);
+                }
+                err = EACCES;
+            }
+        }
+
+        if (*end == '\0') {
+            break;
+        }
+        path = end + 1;
+    }
+
+    errno = err;
+    return NULL;
+}
+
+const char* cmdhash_lookup(const char* name) {
+    const char* path = var_get("PATH");
+    cmdhash_entry* entry;
+
+    if (strchr(name, '/')) {
+        return name;
+    }
+    if (*name == '\0') {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    check_path(path ? path : "/bin:/usr/bin");
+
+    entry = hashtab_get(cmdhash_table, name);
+    if (entry && (entry->path || monotonic_seconds() < entry->expires)) {
+        entry->hits++;
+        if (!entry->path) {
+            errno = ENOENT;
+        }
+        return entry->path;
+    }
+
+    if (!entry) {
+        entry = calloc(1, sizeof(*entry));
+        hashtab_put(cmdhash_table, name, entry);
+    }
+    entry->hits++;
+    entry->path = search_path(name, cached_path);
+    if (!entry->path) {
+        int err = errno;
+        if (err == EACCES) {
+            /* not a miss, the file exists: do not remember it */
+            hashtab_remove(cmdhash_table, name);
+        } else {
+            entry->expires = monotonic_seconds() + CMDHASH_MISS_TTL;
+        }
+        errno = err;
+        return NULL;
+    }
+    return entry->path;
+}
+
+bool cmdhash_forget(const char* name) {
+    cmdhash_entry* entry;
+    if (!cmdhash_table || !(entry = hashtab_get(cmdhash_table, name)) || !entry->path) {
+        return false;
+    }
+    hashtab_remove(cmdhash_table, name);
+    return true;
+}
+
+void cmdhash_reset() {
+    if (cmdhash_table) {
+        hashtab_clear(cmdhash_table);
+    }
+}
+
+void cmdhash_release() {
+    if (cmdhash_table) {
+        release_hashtab(cmdhash_table);
+        cmdhash_table = NULL;
+    }
+    free(cached_path);
+    cached_path = NULL;
+}
@@ -0,0 +1,55 @@
+/* cmdhash.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_CMDHASH_H
+#define IMP_CMDHASH_H
+
+#include <stdbool.h>
+#include "hashtab.h"
+
+/* Seconds a "command not found" is remembered before PATH is searched again */
+#define CMDHASH_MISS_TTL 2
+
+/* Cached result of a PATH search */
+typedef struct {
+    char* path;                 /* Resolved executable, NULL if not found */
+    long expires;               /* Monotonic second a miss is dropped at */
+    unsigned long hits;         /* Times the entry was used */
+} cmdhash_entry;
+
+/* Command name -> cmdhash_entry table, exposed for the hash builtin */
+extern hashtab* cmdhash_table;
+
+/* Resolve a command name to the executable that execvp() would run.
+ * Results are cached until PATH changes; misses are cached for
+ * CMDHASH_MISS_TTL seconds. Names containing a '/' are returned as-is.
+ * Return NULL with errno set when the command is not found. */
+const char* cmdhash_lookup(const char* name);
+
+/* Drop the cached path for name (e.g. it no longer exists).
+ * Return true if a path was cached for it. */
+bool cmdhash_forget(const char* name);
+
+/* Forget every cached command */
+void cmdhash_reset();
+
+/* Release the cache */
+void cmdhash_release();
+
+#endif
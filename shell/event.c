@@ -0,0 +1,199 @@
+/* event.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event.h"
+
+/* A watched descriptor */
+typedef struct {
+    int fd;
+    short events;               /* POLLIN or POLLOUT */
+    event_handler handler;
+    void* data;
+} event_source;
+
+static event_source* sources;
+static size_t nsources, sources_size;
+static struct pollfd* poll_fds;
+
+/* Signals are written here by the signal handler and read by the loop */
+static int signal_pipe[2] = {-1, -1};
+static event_signal_handler signal_handlers[NSIG];
+
+void event_init() {
+    poll_fds = malloc(2 * sizeof(*poll_fds));
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        signal_pipe[0] = signal_pipe[1] = -1;
+    }
+}
+
+void event_release() {
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+    signal_pipe[0] = signal_pipe[1] = -1;
+    free(sources);
+    free(poll_fds);
+    sources = NULL;
+    poll_fds = NULL;
+    nsources = sources_size = 0;
+}
+
+void event_after_fork() {
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        signal_pipe[0] = signal_pipe[1] = -1;
+    }
+    nsources = 0;
+}
+
+/* Watch fd for events, replacing any previous watch */
+static void watch(int fd, short events, event_handler handler, void* data) {
+    size_t i;
+    for (i = 0; i < nsources && sources[i].fd != fd; i++);
+    if (i == nsources) {
+        if (nsources == sources_size) {
+            sources_size = sources_size ? sources_size * 2 : 8;
+            sources = realloc(sources, sources_size * sizeof(*sources));
+            poll_fds = realloc(poll_fds, (sources_size + 2) * sizeof(*poll_fds));
+        }
+        nsources++;
+    }
+    sources[i].fd = fd;
+    sources[i].events = events;
+    sources[i].handler = handler;
+    sources[i].data = data;
+}
+
+void event_watch(int fd, event_handler handler, void* data) {
+    watch(fd, POLLIN, handler, data);
+}
+
+void event_watch_output(int fd, event_handler handler, void* data) {
+    watch(fd, POLLOUT, handler, data);
+}
+
+void event_unwatch(int fd) {
+    size_t i;
+    for (i = 0; i < nsources; i++) {
+        if (sources[i].fd == fd) {
+            sources[i] = sources[--nsources];
+            return;
+        }
+    }
+}
+
+/* Async-signal-safe part: only queue the signal number */
+static void queue_signal(int signo) {
+    int saved = errno;
+    unsigned char byte = (unsigned char) signo;
+    (void) !write(signal_pipe[1], &byte, 1); /* a full pipe already has pending signals */
+    errno = saved;
+}
+
+void event_signal(int signo, event_signal_handler handler) {
+    struct sigaction action;
+
+    signal_handlers[signo] = handler;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = queue_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(signo, &action, NULL);
+}
+
+/* Run the handlers of the queued signals, each one once */
+static void dispatch_signals() {
+    unsigned char bytes[64];
+    bool pending[NSIG] = {false};
+    ssize_t i, n;
+    int signo;
+
+    while ((n = read(signal_pipe[0], bytes, sizeof(bytes))) > 0) {
+        for (i = 0; i < n; i++) {
+            pending[bytes[i]] = true;
+        }
+    }
+    for (signo = 1; signo < NSIG; signo++) {
+        if (pending[signo] && signal_handlers[signo]) {
+            signal_handlers[signo](signo);
+        }
+    }
+}
+
+int event_wait(int fd, int timeout) {
+    size_t i, n;
+    int ready;
+
+    while (true) {
+        /* slot 0: signals, slot 1: the awaited fd, then the watched ones */
+        n = nsources + 2;
+        poll_fds[0].fd = signal_pipe[0];
+        poll_fds[1].fd = fd;
+        poll_fds[0].events = poll_fds[1].events = POLLIN;
+        for (i = 0; i < nsources; i++) {
+            poll_fds[i + 2].fd = sources[i].fd;
+            poll_fds[i + 2].events = sources[i].events;
+        }
+        for (i = 0; i < n; i++) {
+            poll_fds[i].revents = 0;
+        }
+
+        ready = poll(poll_fds, n, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue; /* the signal is in the pipe now */
+            }
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+
+        if (poll_fds[0].revents) {
+            dispatch_signals();
+        }
+        for (i = 2; i < n; i++) {
+            /* handlers may watch or unwatch, so look the source up again */
+            if (poll_fds[i].revents) {
+                size_t j;
+                for (j = 0; j < nsources && sources[j].fd != poll_fds[i].fd; j++);
+                if (j < nsources) {
+                    sources[j].handler(sources[j].fd, sources[j].data);
+                }
+            }
+        }
+
+        if (fd >= 0 && poll_fds[1].revents) {
+            return 1;
+        }
+        if (fd < 0) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/* event.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_EVENT_H
+#define IMP_EVENT_H
+
+#include <stdbool.h>
+
+/* Handler of a watched descriptor that became readable (or writable) */
+typedef void (*event_handler)(int fd, void* data);
+
+/* Handler of a signal, run from the event loop and not in signal context */
+typedef void (*event_signal_handler)(int signo);
+
+/* Create the signal self-pipe */
+void event_init();
+
+/* Release the event loop resources */
+void event_release();
+
+/* In a forked child that keeps running shell code: take a signal pipe of
+ * its own (the inherited one is shared with the parent) and forget the
+ * watched descriptors, signal handlers are kept */
+void event_after_fork();
+
+/* Call handler(fd, data) from the event loop whenever fd is readable */
+void event_watch(int fd, event_handler handler, void* data);
+
+/* Call handler(fd, data) from the event loop whenever fd is writable,
+ * instead of readable */
+void event_watch_output(int fd, event_handler handler, void* data);
+
+/* Stop watching fd */
+void event_unwatch(int fd);
+
+/* Deliver signo to handler through the event loop. The real signal
+ * handler only writes the signal number to a pipe, so handler may do
+ * anything. Interrupted system calls are restarted. */
+void event_signal(int signo, event_signal_handler handler);
+
+/* Run the event loop until fd is readable (fd < 0 waits for events only)
+ * or timeout milliseconds have passed (-1 waits forever). Return 1 when fd
+ * is readable, 0 on timeout or after handling events when fd < 0, and -1
+ * on error. */
+int event_wait(int fd, int timeout);
+
+#endif
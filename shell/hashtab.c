@@ -0,0 +1,159 @@
+/* hashtab.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtab.h"
+#include "tparse.h"
+
+#define HASHTAB_INITIAL 64
+
+hashtab* new_hashtab(void (*del)(void*)) {
+    hashtab* table = calloc(1, sizeof(*table));
+    table->nbuckets = HASHTAB_INITIAL;
+    table->buckets = calloc(table->nbuckets, sizeof(*table->buckets));
+    table->del = del;
+    return table;
+}
+
+void release_hashtab(hashtab* table) {
+    hashtab_clear(table);
+    free(table->buckets);
+    free(table);
+}
+
+/* FNV-1a */
+unsigned long hashtab_hash(const char* key) {
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char) *key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+hashtab_entry* hashtab_find(hashtab* table, const char* key) {
+    unsigned long hash = hashtab_hash(key);
+    hashtab_entry* e;
+    for (e = table->buckets[hash & (table->nbuckets - 1)]; e; e = e->next) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void* hashtab_get(hashtab* table, const char* key) {
+    hashtab_entry* e = hashtab_find(table, key);
+    return e ? e->value : NULL;
+}
+
+/* Double the number of buckets, rehashing from the cached hashes */
+static void hashtab_grow(hashtab* table) {
+    size_t i, nbuckets = table->nbuckets * 2;
+    hashtab_entry** buckets = calloc(nbuckets, sizeof(*buckets));
+    hashtab_entry* e, * next;
+
+    for (i = 0; i < table->nbuckets; i++) {
+        for (e = table->buckets[i]; e; e = next) {
+            next = e->next;
+            e->next = buckets[e->hash & (nbuckets - 1)];
+            buckets[e->hash & (nbuckets - 1)] = e;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->nbuckets = nbuckets;
+}
+
+hashtab_entry* hashtab_put(hashtab* table, const char* key, void* value) {
+    hashtab_entry* e = hashtab_find(table, key);
+    size_t bucket;
+
+    if (e) {
+        if (table->del && e->value != value) {
+            table->del(e->value);
+        }
+        e->value = value;
+        return e;
+    }
+
+    if (table->size >= table->nbuckets) {
+        hashtab_grow(table);
+    }
+
+    e = malloc(sizeof(*e));
+    e->key = stringdup(key);
+    e->hash = hashtab_hash(key);
+    e->value = value;
+    bucket = e->hash & (table->nbuckets - 1);
+    e->next = table->buckets[bucket];
+    table->buckets[bucket] = e;
+    table->size++;
+    return e;
+}
+
+static void release_entry(hashtab* table, hashtab_entry* e) {
+    if (table->del) {
+        table->del(e->value);
+    }
+    free(e->key);
+    free(e);
+}
+
+bool hashtab_remove(hashtab* table, const char* key) {
+    unsigned long hash = hashtab_hash(key);
+    hashtab_entry** link = &table->buckets[hash & (table->nbuckets - 1)];
+
+    for (; *link; link = &(*link)->next) {
+        hashtab_entry* e = *link;
+        if (e->hash == hash && strcmp(e->key, key) == 0) {
+            *link = e->next;
+            release_entry(table, e);
+            table->size--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void hashtab_clear(hashtab* table) {
+    size_t i;
+    hashtab_entry* e, * next;
+    for (i = 0; i < table->nbuckets; i++) {
+        for (e = table->buckets[i]; e; e = next) {
+            next = e->next;
+            release_entry(table, e);
+        }
+        table->buckets[i] = NULL;
+    }
+    table->size = 0;
+}
+
+void hashtab_foreach(hashtab* table, void (*fn)(hashtab_entry* entry, void* data), void* data) {
+    size_t i;
+    hashtab_entry* e, * next;
+    for (i = 0; i < table->nbuckets; i++) {
+        for (e = table->buckets[i]; e; e = next) {
+            next = e->next;
+            fn(e, data);
+        }
+    }
+}
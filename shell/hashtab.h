@@ -0,0 +1,69 @@
+/* hashtab.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_HASHTAB_H
+#define IMP_HASHTAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Entry of a string keyed hash table, chained on bucket collisions */
+typedef struct hashtab_entry {
+    struct hashtab_entry* next; /* Next entry in the same bucket */
+    unsigned long hash;         /* Cached hash of key */
+    char* key;                  /* Owned copy of the key */
+    void* value;                /* Value associated to the key */
+} hashtab_entry;
+
+/* String keyed hash table, grows as entries are added */
+typedef struct hashtab {
+    hashtab_entry** buckets;    /* Bucket heads, nbuckets is a power of two */
+    size_t nbuckets;            /* Number of buckets */
+    size_t size;                /* Number of entries */
+    void (*del)(void*);         /* Function used to free a value, may be NULL */
+} hashtab;
+
+/* Return a new empty table, del is used to release values */
+hashtab* new_hashtab(void (*del)(void*));
+
+/* Release the table, its entries and their values */
+void release_hashtab(hashtab* table);
+
+/* Hash function used for the keys */
+unsigned long hashtab_hash(const char* key);
+
+/* Find the entry for key, NULL if there is none */
+hashtab_entry* hashtab_find(hashtab* table, const char* key);
+
+/* Value associated to key, NULL if there is none */
+void* hashtab_get(hashtab* table, const char* key);
+
+/* Associate value to key, releasing the value it replaces */
+hashtab_entry* hashtab_put(hashtab* table, const char* key, void* value);
+
+/* Remove key from the table, return false if it was not there */
+bool hashtab_remove(hashtab* table, const char* key);
+
+/* Remove every entry from the table */
+void hashtab_clear(hashtab* table);
+
+/* Call fn for every entry in the table, in no particular order */
+void hashtab_foreach(hashtab* table, void (*fn)(hashtab_entry* entry, void* data), void* data);
+
+#endif
@@ -16,117 +16,582 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
+#include <errno.h>
 #include <assert.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 
 #include "job.h"
 #include "royaldutch.h"
+#include "launch.h"
+#include "cmdhash.h"
+#include "trace.h"
+#include "builtin.h"
+#include "jobserver.h"
+#include "vars.h"
+#include "event.h"
+#include "cgroup.h"
+#include "affinity.h"
+#include "priority.h"
+#include "metrics.h"
+
+/* False once pidfd_open() failed with ENOSYS: exits are then collected
+ * with wait4(-1) on SIGCHLD */
+static bool have_pidfd = true;
 
-job* job_from_pipeline(pipeline_t* pipeline, char* command_line) {
-    int i, j;
-    job* job = calloc(1, sizeof(*job));
+/* Running processes pidfd_open() failed for otherwise (EMFILE...), their
+ * exits are collected with wait4(-1) too */
+static size_t processes_without_pidfd;
 
-    /* Open input file or use stdin, it is closed upon running */
-    if (REDIRECT_STDIN(pipeline)) {
-        job->in = open(pipeline->file_in, O_RDONLY);
-        assert(job->in != -1);
+/* Open a pidfd for proc and reap it from the event loop when it exits */
+static void watch_process(process* proc) {
+    proc->pidfd = -1;
+#ifdef SYS_pidfd_open
+    if (have_pidfd) {
+        proc->pidfd = (int) syscall(SYS_pidfd_open, proc->pid, 0);
+        if (proc->pidfd < 0 && errno == ENOSYS) {
+            have_pidfd = false;
+        }
+    }
+#else
+    have_pidfd = false;
+#endif
+    if (proc->pidfd >= 0) {
+        event_watch(proc->pidfd, process_event, proc);
     } else {
-        job->in = STDIN_FILENO;
+        processes_without_pidfd++;
+    }
+}
+
+/* Stop watching a process that completed or is released */
+static void unwatch_process(process* proc) {
+    if (proc->pidfd >= 0) {
+        event_unwatch(proc->pidfd);
+        close(proc->pidfd);
+        proc->pidfd = -1;
+    } else if (proc->pid > 0 && !proc->completed) {
+        processes_without_pidfd--;
     }
+}
 
-    /* Open output file or use stdout, it is closed upon running */
-    if (REDIRECT_STDOUT(pipeline)) {
-        job->out = open(pipeline->file_out, O_RDWR | O_CREAT | O_TRUNC, 0664);
-        assert(job->out != -1);
+/* Wait status of a waitid() report */
+static int siginfo_status(const siginfo_t* info) {
+    switch (info->si_code) {
+    case CLD_EXITED:
+        return W_EXITCODE(info->si_status, 0);
+    case CLD_KILLED:
+        return info->si_status;
+    case CLD_DUMPED:
+        return info->si_status | WCOREFLAG;
+    default:
+        return W_STOPCODE(info->si_status);
+    }
+}
+
+/* Value of the parameter referenced at s, just after a '$', NULL if it
+ * is not set. *length is set to the characters the reference takes, 0
+ * if the '$' is a plain character. number holds $?, $! and $$. */
+static const char* param_value(pipeline_t* pipeline, const char* s, const char* end, int* length, char* number) {
+    const char* name = s;
+    int n = 0;
+
+    if (*s == '{') {
+        const char* close = memchr(s, '}', end - s);
+        name = s + 1;
+        n = close ? close - name : -1;
+        *length = n + 2;
+    } else if (s < end && (*s == '?' || *s == '!' || *s == '$')) {
+        n = *length = 1;
     } else {
-        job->out = STDOUT_FILENO;
+        while (s + n < end && var_valid_name(s, n + 1)) {
+            n++;
+        }
+        *length = n;
     }
-    /* stdeer redirection is not supported by the foo shell parser */
-    job->err = STDERR_FILENO;
 
-    job->background = RUN_BACKGROUND(pipeline);
+    if (n == 1 && (*name == '?' || *name == '!' || *name == '$')) {
+        long value = *name == '?' ? last_status : *name == '$' ? shell_pid : last_background;
+        if (*name == '!' && last_background == 0) {
+            return NULL;
+        }
+        sprintf(number, "%ld", value);
+        return number;
+    }
+    if (n <= 0 || !var_valid_name(name, n)) {
+        *length = 0;
+        return NULL;
+    }
+    return var_get(arena_strndup(pipeline->arena, name, n));
+}
 
-    job->command_line = stringdup(command_line);
+/* Copy the length characters at s to dst (when not NULL) without their
+ * quotes and escapes, with $NAME, ${NAME}, $?, $! and $$ replaced by
+ * their values outside single quotes. The text of a here-document (here)
+ * is taken as if double quoted, without the quotes. Return the
+ * resulting length. */
+static int expand_text(pipeline_t* pipeline, const char* s, int length, bool here, char* dst) {
+    const char* end = s + length;
+    bool quoted = here; /* inside "" */
+    char number[24];
+    int n = 0;
 
-    /* Populate processes */
-    job->number_procs = (size_t) pipeline->ncommands;
-    job->procs = calloc(job->number_procs, sizeof(*job->procs));
+#define EMIT(c) do { char emitted = (c); if (dst) { dst[n] = emitted; } n++; } while (0)
+    while (s < end) {
+        char c = *s++;
+        if (c == '\\' && !quoted) {
+            if (s < end) {
+                EMIT(*s++);
+            }
+        } else if (c == '\\' && s < end && strchr(here ? "\\$`" : "\"\\$`", *s)) {
+            EMIT(*s++); /* inside double quotes backslash only escapes these */
+        } else if (c == '\'' && !quoted) {
+            while (*s != '\'') {
+                EMIT(*s++);
+            }
+            s++;
+        } else if (c == '"' && !here) {
+            quoted = !quoted;
+        } else if (c == '$' && s < end) {
+            int used;
+            const char* value = param_value(pipeline, s, end, &used, number);
+            if (used == 0) {
+                EMIT(c);
+            }
+            for (; value && *value; value++) {
+                EMIT(*value);
+            }
+            s += used;
+        } else {
+            EMIT(c);
+        }
+    }
+#undef EMIT
+    return n;
+}
 
-    for (i = 0; i < job->number_procs; ++i) {
-        process* proc = &job->procs[i];
-        proc->argc = (size_t) pipeline->narguments[i];
-        proc->argv = malloc((proc->argc + 1) * sizeof(*proc->argv));
-        proc->argv[proc->argc] = 0;
-        for (j = 0; j < proc->argc; ++j) {
-            char* command = NULL;
-            if(pipeline->command[i][j][0] == '$' && strlen(pipeline->command[i][j]) >= 2) {
-                command = getenv(pipeline->command[i][j]+1);
-                if(command) {
-                    command = stringdup(command);
+/* Expand the length characters at s into the arena, see expand_text() */
+static char* expand_string(pipeline_t* pipeline, const char* s, int length, bool here) {
+    int expanded = expand_text(pipeline, s, length, here, NULL);
+    char* value = arena_alloc(pipeline->arena, expanded + 1);
+    expand_text(pipeline, s, length, here, value);
+    value[expanded] = '\0';
+    return value;
+}
+
+/* Expand a word of the pipeline into its arena */
+static const char* expand_word(pipeline_t* pipeline, word_t word) {
+    char* value;
+
+    if (!memchr(pipeline->line + word.offset, '$', word.length)) {
+        /* nothing to expand, only quotes and escapes to remove */
+        value = arena_alloc(pipeline->arena, word.length + 1);
+        value[unquote_word(pipeline->line, word, value)] = '\0';
+        return value;
+    }
+    return expand_string(pipeline, pipeline->line + word.offset, word.length, false);
+}
+
+/* A sealed memfd with the length bytes of text, read from its start:
+ * the input of a here-document or here-string, -1 on error */
+static int open_here_text(const char* text, size_t length) {
+    int fd = memfd_create("here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    size_t written = 0;
+
+    if (fd < 0) {
+        return -1;
+    }
+    while (written < length) {
+        ssize_t n = write(fd, text + written, length - written);
+        if (n < 0 && errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+        written += n > 0 ? n : 0;
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* True if word, expanded to value, is a NAME=value assignment: the name
+ * and the '=' are not quoted nor the result of an expansion */
+static bool is_assignment(pipeline_t* pipeline, word_t word, const char* value) {
+    size_t length = var_assignment(value);
+    return length > 0 && length < word.length
+           && memcmp(pipeline->line + word.offset, value, length + 1) == 0;
+}
+
+/* Open the pipeline redirections into the job descriptors, false on error */
+static bool open_redirects(struct job* job, pipeline_t* pipeline) {
+    redirect_t* r;
+
+    for (r = pipeline->redirect; r; r = r->next) {
+        int* fd = r->fd == 0 ? &job->in : r->fd == 1 ? &job->out : &job->err;
+        const char* file;
+        int opened;
+
+        if (r->mode == REDIRECT_HEREDOC) {
+            /* the text is written once, the process reads it in place */
+            file = r->here_expand ? expand_string(pipeline, r->here, r->here_length, true) : r->here;
+            opened = open_here_text(file, strlen(file));
+            file = "here-document";
+        } else if (r->mode == REDIRECT_HERESTRING) {
+            size_t length;
+            char* text;
+            file = expand_word(pipeline, r->file);
+            length = strlen(file);
+            text = arena_alloc(pipeline->arena, length + 1);
+            memcpy(text, file, length);
+            text[length] = '\n'; /* the word is a line */
+            opened = open_here_text(text, length + 1);
+            file = "here-string";
+        } else {
+            int flags = r->mode == REDIRECT_READ ? O_RDONLY :
+                        r->mode == REDIRECT_APPEND ? O_WRONLY | O_CREAT | O_APPEND :
+                        O_WRONLY | O_CREAT | O_TRUNC;
+            file = expand_word(pipeline, r->file);
+            opened = open(file, flags | O_CLOEXEC, 0664);
+        }
+
+        if (opened == -1) {
+            print_error((char*) file);
+            return false;
+        }
+        if (*fd != r->fd) {
+            close(*fd); /* a later redirection of the same descriptor wins */
+        }
+        *fd = opened;
+    }
+    return true;
+}
+
+/* Seconds of a duration like 1.5, 30s, 10m, 2h or 1d, -1 if invalid */
+static double parse_duration(const char* s) {
+    char* end;
+    double seconds = strtod(s, &end);
+
+    if (end == s || !(seconds >= 0 && seconds < 1e9) || (*end && end[1])) {
+        return -1;
+    }
+    switch (*end) {
+    case '\0':
+    case 's':
+        return seconds;
+    case 'm':
+        return seconds * 60;
+    case 'h':
+        return seconds * 3600;
+    case 'd':
+        return seconds * 86400;
+    default:
+        return -1;
+    }
+}
+
+/* Make the timerfd fd readable in seconds, once */
+static void arm_timer(int fd, double seconds) {
+    struct itimerspec when = {{0, 0}, {0, 0}};
+    when.it_value.tv_sec = (time_t) seconds;
+    when.it_value.tv_nsec = (long) ((seconds - (double) when.it_value.tv_sec) * 1e9);
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) {
+        when.it_value.tv_nsec = 1; /* zero would disarm it */
+    }
+    timerfd_settime(fd, 0, &when, NULL);
+}
+
+/* The deadline of a job passed: SIGTERM it (continued, if it is stopped
+ * it could not exit), then SIGKILL it kill_after seconds later */
+static void deadline_event(int fd, void* data) {
+    job* j = data;
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) < 0 || job_completed(j)) {
+        return;
+    }
+    if (j->timeout_signal == 0) {
+        j->timeout_signal = SIGTERM;
+        job_signal(j, SIGTERM);
+        job_signal(j, SIGCONT);
+        arm_timer(fd, j->kill_after);
+    } else if (j->timeout_signal == SIGTERM) {
+        j->timeout_signal = SIGKILL;
+        job_signal(j, SIGKILL);
+    }
+}
+
+/* Start the clock of a launched job with a deadline. The timerfd is
+ * watched by the event loop that waits for the job, so neither a helper
+ * process nor polling is needed. */
+static void start_deadline(job* j) {
+    if (j->timeout <= 0 || job_completed(j)) {
+        return;
+    }
+    j->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (j->timer < 0) {
+        perror("timeout");
+        return;
+    }
+    arm_timer(j->timer, j->timeout);
+    event_watch(j->timer, deadline_event, j);
+}
+
+/* Drop the deadline of a job that completed or is released */
+static void stop_deadline(job* j) {
+    if (j->timer >= 0) {
+        event_unwatch(j->timer);
+        close(j->timer);
+        j->timer = -1;
+    }
+}
+
+/* Mark a process as finished with status, dropping it from the pid index */
+static void complete_process(process* proc, int status, const struct rusage* usage);
+
+/* Strip the prefixes of the first command, in any order:
+ *   time <pipeline>: run the pipeline and report its usage
+ *   timeout [-k grace] duration <pipeline>: a deadline for the job,
+ *     forked foreground jobs get the one of the session otherwise
+ *   limit [-c cpu%] [-m memory] [-p pids] <pipeline>: a cgroup of its own
+ *   pin [-s] {-n node | cpus} <pipeline>: run on these CPUs, or the ones
+ *     of a NUMA node, each process on the next one of them with -s
+ * Return false, with the error reported, on a bad prefix. */
+static bool strip_prefixes(job* job) {
+    process* proc = &job->procs[0];
+    size_t skip;
+
+    job->kill_after = TIMEOUT_KILL_AFTER;
+    for (;; proc->argv += skip, proc->argc -= skip) {
+        skip = 0;
+        if (proc->argc > 1 && strcmp(proc->argv[0], "time") == 0) {
+            job->timed = true;
+            skip = 1;
+        } else if (proc->argc > 2 && strcmp(proc->argv[0], "timeout") == 0) {
+            skip = 2;
+            if (strcmp(proc->argv[1], "-k") == 0 && proc->argc > 4) {
+                job->kill_after = parse_duration(proc->argv[2]);
+                skip = 4;
+            }
+            job->timeout = parse_duration(proc->argv[skip - 1]);
+            if (job->timeout < 0 || job->kill_after < 0) {
+                fprintf(stderr, "timeout: invalid duration\n");
+                return false;
+            }
+        } else if (proc->argc > 1 && strcmp(proc->argv[0], "limit") == 0) {
+            for (skip = 1; skip + 2 < proc->argc && proc->argv[skip][0] == '-'; skip += 2) {
+                const char* value = proc->argv[skip + 1];
+                if (strcmp(proc->argv[skip], "-c") == 0 && cgroup_cpu_valid(value)) {
+                    job->cpu_limit = value;
+                } else if (strcmp(proc->argv[skip], "-m") == 0) {
+                    job->memory_limit = value;
+                } else if (strcmp(proc->argv[skip], "-p") == 0) {
+                    job->pids_limit = value;
                 } else {
-                    command = stringdup("");
+                    break;
                 }
+            }
+            if (skip == 1 || proc->argv[skip][0] == '-') {
+                fprintf(stderr, "limit: usage: limit [-c cpu%%] [-m memory] [-p pids] <pipeline>\n");
+                return false;
+            }
+            if (!cgroup_enabled()) {
+                fprintf(stderr, "limit: %s is not set to a cgroup v2 directory\n", CGROUP_ENV);
+                return false;
+            }
+        } else if (proc->argc > 2 && strcmp(proc->argv[0], "pin") == 0) {
+            skip = 1;
+            if (strcmp(proc->argv[skip], "-s") == 0) {
+                job->spread = true;
+                skip++;
+            }
+            free(job->cpu_list);
+            if (strcmp(proc->argv[skip], "-n") == 0 && skip + 2 < proc->argc) {
+                job->cpu_list = affinity_node(atoi(proc->argv[skip + 1]));
+                skip += 2;
+            } else if (skip + 1 < proc->argc && proc->argv[skip][0] != '-') {
+                job->cpu_list = strdup(proc->argv[skip]);
+                skip++;
             } else {
-                command = stringdup(pipeline->command[i][j]);
+                job->cpu_list = NULL;
+            }
+            if (!job->cpu_list) {
+                fprintf(stderr, "pin: usage: pin [-s] {-n node | cpu-list} <pipeline>\n");
+                return false;
             }
-            proc->argv[j] = command;
+            if (!affinity_valid(job->cpu_list)) {
+                fprintf(stderr, "pin: %s: not a list of CPUs the shell may run on\n", job->cpu_list);
+                return false;
+            }
+        } else {
+            break;
         }
     }
 
-    return job;
+    return true;
 }
 
-void launch_process(struct job* job, process* proc, int in_file, int out_file) {
-    int pid;
-
-    /* TODO: we have really no good way to say execvp has failed, we should try changing the fork()
-     * to a posix_spawn() (or vfork() but that seems creepy) */
-    pid = fork();
-    if (pid == 0) {
-        /* Child */
-        if (on_terminal) {
-            pid = getpid();
-            if (job->pgid == 0) {
-                job->pgid = pid; /*NOTE: remember this is the child process, it doesn't change the value in the parent*/
-            }
-            setpgid(pid, job->pgid); /* move to the appropriate process group (maybe become leader) */
-            if (!job->background && job->procs == proc) { /* this is first process and the job is on foreground */
-                tcsetpgrp(shell_in, job->pgid); /* move it foreground*/
-            }
-            set_signals(SIG_DFL, true);   /* Reset signals the shell is ignoring */
+job* job_from_pipeline(pipeline_t* pipeline) {
+    int i, j, k;
+    size_t size, nargs = 0, nchars = pipeline->text.length + 1;
+    const char** words;
+    char** argv;
+    char* strings;
+    job* job;
+
+    /* Expand every word first to know how much room they take */
+    for (i = 0; i < pipeline->ncommands; ++i) {
+        nargs += (size_t) pipeline->command[i].nwords + 1;
+    }
+    words = arena_alloc(pipeline->arena, nargs * sizeof(*words));
+    for (i = 0, k = 0; i < pipeline->ncommands; ++i) {
+        for (j = 0; j < pipeline->command[i].nwords; ++j, ++k) {
+            words[k] = expand_word(pipeline, pipeline->command[i].words[j]);
+            nchars += strlen(words[k]) + 1;
         }
+    }
+
+    /* The job, its processes, their argument vectors and all the strings
+     * are kept in a single block, released at once by release_job() */
+    size = sizeof(*job) + pipeline->ncommands * sizeof(*job->procs) + nargs * sizeof(*argv) + nchars;
+    job = calloc(1, size);
+    job->procs = (process*) (job + 1);
+    argv = (char**) (job->procs + pipeline->ncommands);
+    strings = (char*) (argv + nargs);
+
+    /* Redirected files are closed upon running */
+    job->in = STDIN_FILENO;
+    job->out = STDOUT_FILENO;
+    job->err = STDERR_FILENO;
+    job->token = -1;
+    job->timeout = -1; /* no timeout prefix */
+    job->timer = -1;
+    job->cgroup = -1;
+    for (i = 0; i < pipeline->ncommands; ++i) {
+        job->procs[i].pidfd = -1;
+    }
+    if (!open_redirects(job, pipeline)) {
+        release_job(job);
+        return NULL;
+    }
+
+    job->background = RUN_BACKGROUND(pipeline);
 
-        if (in_file != STDIN_FILENO) {
-            /* Redirect input */
-            dup2(in_file, STDIN_FILENO);
-            close(in_file);
+    /* the pipeline text, for job listings */
+    job->command_line = strings;
+    memcpy(strings, pipeline->line + pipeline->text.offset, pipeline->text.length);
+    strings[pipeline->text.length] = '\0';
+    strings += pipeline->text.length + 1;
+
+    /* Populate processes */
+    job->number_procs = (size_t) pipeline->ncommands;
+
+    for (i = 0, k = 0; i < job->number_procs; ++i) {
+        process* proc = &job->procs[i];
+        proc->job = job;
+        proc->argc = (size_t) pipeline->command[i].nwords;
+        proc->argv = argv;
+        for (j = 0; j < proc->argc; ++j, ++k) {
+            proc->argv[j] = strings;
+            strings = stpcpy(strings, words[k]) + 1;
         }
+        proc->argv[proc->argc] = 0;
+        argv += proc->argc + 1;
+    }
+
+    /* time, timeout and limit wrap the pipeline */
+    if (!strip_prefixes(job)) {
+        release_job(job);
+        return NULL;
+    }
 
-        if (out_file != STDOUT_FILENO) {
-            /* Redirect output */
-            dup2(out_file, STDOUT_FILENO);
-            close(out_file);
+    /* leading NAME=value words are assignments, not arguments */
+    for (i = 0; i < job->number_procs; ++i) {
+        process* proc = &job->procs[i];
+        word_t* word = pipeline->command[i].words + (pipeline->command[i].nwords - proc->argc);
+        proc->assigns = proc->argv;
+        while (proc->argc > 0 && is_assignment(pipeline, word[proc->nassigns], proc->argv[0])) {
+            proc->nassigns++;
+            proc->argv++;
+            proc->argc--;
         }
+    }
 
-        execvp(proc->argv[0], proc->argv);
-        print_error("execvp"); /* TODO: signal parent process (shell) */
-        exit(1);
-    } else if (pid == -1) {
-        /* Error */
-        print_error("fork");
-        exit(1);
+    return job;
+}
+
+void launch_process(struct job* job, process* proc, int in_file, int out_file) {
+    pid_t pid;
+    uint64_t start = TRACE_BEGIN(), measure = METRICS_BEGIN();
+    const builtin* b;
+
+    clock_gettime(CLOCK_MONOTONIC, &proc->started);
+    if (proc->argc == 0) {
+        /* assignments alone, in a pipeline or background: they do not
+         * outlive the process they would run in */
+        proc->pid = 0;
+        complete_process(proc, 0, NULL);
+        return;
+    }
+    b = find_builtin(proc->argv[0]);
+    if (b) {
+        pid = spawn_builtin(job, proc, b, in_file, out_file);
     } else {
-        /* Parent */
-        proc->pid = pid;
-        if (on_terminal) {
-            if (job->pgid == 0) {
-                job->pgid = pid;
-            }
-            setpgid(pid, job->pgid);
+        pid = spawn_process(job, proc, in_file, out_file);
+    }
+    TRACE_END("launch_process", start, proc->argv[0], pid);
+
+    if (pid == -1 && !b && errno == ENOENT && cmdhash_forget(proc->argv[0])) {
+        /* the cached path went stale, search PATH again */
+        pid = spawn_process(job, proc, in_file, out_file);
+    }
+
+    METRICS_END(METRIC_SPAWN, measure);
+    if (pid == -1) {
+        /* Could not run the program, report it as a finished process
+         * with the usual "command not found/not executable" status */
+        int status = W_EXITCODE(errno == ENOENT ? 127 : 126, 0);
+        print_error(proc->argv[0]);
+        if (on_terminal && !job->background && job->procs == proc) {
+            tcsetpgrp(shell_in, shell_pgid); /* the failed leader may have taken the terminal */
         }
+        proc->pid = 0;
+        complete_process(proc, status, NULL);
+        METRICS_COUNT(METRIC_EXEC_FAILURES);
+        return;
+    }
+
+    METRICS_COUNT(METRIC_SPAWNS);
+    METRICS_COMMAND(proc->argv[0]);
+    proc->pid = pid;
+    watch_process(proc);
+    if (on_terminal && job->pgid == 0) {
+        job->pgid = pid;
+    }
+}
+
+/* Choose the CPUs of each process: the ones of the pin prefix (one of
+ * them per process with -s), or the next CPU of the shell for background
+ * jobs under automatic placement */
+static void place_job(job* j) {
+    const char* placement;
+    size_t i;
+
+    if (!j->cpu_list && j->background
+        && (placement = var_get(AFFINITY_VAR)) && strcmp(placement, "auto") == 0) {
+        j->cpu_list = affinity_next();
+    }
+    if (!j->cpu_list) {
+        return;
+    }
+    for (i = 0; i < j->number_procs; i++) {
+        j->procs[i].cpus = j->spread ? affinity_nth(j->cpu_list, i) : strdup(j->cpu_list);
     }
 }
 
@@ -134,95 +599,324 @@ void launch_job(struct job* job) {
     int i;
     int pipes[2] = {0, 0};
     int in_file, out_file;
+    uint64_t start;
+    const builtin* b = NULL;
 
     if (!job) { return; }
+    start = TRACE_BEGIN();
+    METRICS_COUNT(METRIC_JOBS);
 
-    in_file = job->in;
-    for (i = 0; i < job->number_procs; i++) {
-        if (i == job->number_procs - 1) {  /*is last process?*/
-            /*set output file*/
-            out_file = job->out;
+    /* background jobs wait for a token, shared with any make they run */
+    if (job->background) {
+        job->token = jobserver_take();
+        TRACE_END("jobserver_take", start, NULL, job->token);
+    }
+
+    /* lone foreground assignments and builtins run in the shell itself,
+     * unless they have a deadline (only a process can be killed on it),
+     * limits (only a process can join the job cgroup) or CPUs (the shell
+     * is not pinned) */
+    if (job->number_procs == 1 && !job->background && job->timeout <= 0 && !job_limited(job)
+        && !job->cpu_list
+        && (job->procs[0].argc == 0 || (b = find_builtin(job->procs[0].argv[0])))) {
+        process* proc = &job->procs[0];
+        int status = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &proc->started);
+        if (proc->argc == 0) {
+            var_assign(proc->assigns, proc->nassigns, NULL);
         } else {
-            /*pipe between processes*/
-            assert(pipe(pipes) == 0);
-            out_file = pipes[1];
+            /* FOO=bar builtin: the assignments last for the builtin only */
+            char** saved = malloc((proc->nassigns ? proc->nassigns : 1) * sizeof(char*));
+            var_assign(proc->assigns, proc->nassigns, saved);
+            METRICS_COMMAND(proc->argv[0]);
+            status = run_builtin(b, proc, job->in, job->out, job->err);
+            var_restore(proc->assigns, proc->nassigns, saved);
+            free(saved);
         }
+        complete_process(proc, W_EXITCODE(status, 0), NULL);
 
-        launch_process(job, &job->procs[i], in_file, out_file);
-
-        /* close access to already redirected files */
-        if (in_file != STDIN_FILENO) {
-            close(in_file);
+        if (job->in != STDIN_FILENO) {
+            close(job->in);
+        }
+        if (job->out != STDOUT_FILENO) {
+            close(job->out);
+        }
+    } else if ((job->cgroup = cgroup_create(&job->cgroup_id, job->cpu_limit, job->memory_limit,
+                                            job->pids_limit)) < 0 && job_limited(job)) {
+        /* the limits could not be set, the job must not run without them:
+         * it fails as if it could not be executed */
+        for (i = 0; i < job->number_procs; i++) {
+            clock_gettime(CLOCK_MONOTONIC, &job->procs[i].started);
+            job->procs[i].pid = 0;
+            complete_process(&job->procs[i], W_EXITCODE(126, 0), NULL);
         }
-        if (out_file != STDOUT_FILENO) {
-            close(out_file);
+        if (job->in != STDIN_FILENO) {
+            close(job->in);
         }
+        if (job->out != STDOUT_FILENO) {
+            close(job->out);
+        }
+    } else {
+        const char* deadline;
+        if (job->timeout < 0 && !job->background && (deadline = var_get(TIMEOUT_VAR)) && *deadline) {
+            job->timeout = parse_duration(deadline); /* none if invalid */
+        }
+        place_job(job);
+        in_file = job->in;
+        for (i = 0; i < job->number_procs; i++) {
+            if (i == job->number_procs - 1) {  /*is last process?*/
+                /*set output file*/
+                out_file = job->out;
+            } else {
+                /*pipe between processes*/
+                assert(pipe2(pipes, O_CLOEXEC) == 0);
+                out_file = pipes[1];
+            }
+
+            launch_process(job, &job->procs[i], in_file, out_file);
+
+            /* close access to already redirected files */
+            if (in_file != STDIN_FILENO) {
+                close(in_file);
+            }
+            if (out_file != STDOUT_FILENO) {
+                close(out_file);
+            }
 
-        /* next input is piped from this output */
-        in_file = pipes[0];
+            /* next input is piped from this output */
+            in_file = pipes[0];
+        }
+    }
+    if (job->err != STDERR_FILENO) {
+        close(job->err);
     }
+
+    /* the redirected files are closed, they belong to the processes now */
+    job->in = STDIN_FILENO;
+    job->out = STDOUT_FILENO;
+    job->err = STDERR_FILENO;
     job->time_run = time(NULL);
+    if (job->background) {
+        job_set_priority(job, true); /* the group, and what was spawned without it */
+    }
+    start_deadline(job);
+    TRACE_END("launch_job", start, NULL, job->number_procs);
 }
 
 void release_job(struct job* job) {
-    int i, j;
-    for (i = 0; i < job->number_procs; ++i) {
-        process* proc = job->procs + i;
-        for (j = 0; j < proc->argc; j++) {
-            free(proc->argv[j]);
-        }
-        free(proc->argv);
+    size_t i;
+
+    for (i = 0; i < job->number_procs; i++) {
+        unwatch_process(&job->procs[i]);
+        free(job->procs[i].cpus);
     }
-    free(job->command_line);
-    free(job->procs);
-    free(job);
+    free(job->cpu_list);
+
+    /* close redirections of a job that was never launched */
+    if (job->in != STDIN_FILENO) {
+        close(job->in);
+    }
+    if (job->out != STDOUT_FILENO) {
+        close(job->out);
+    }
+    if (job->err != STDERR_FILENO) {
+        close(job->err);
+    }
+    jobserver_give(job->token);
+    stop_deadline(job);
+    free(job); /* processes and strings live in the same block */
 }
 
 bool job_stopped(job* j) {
-    int i;
-    for (i = 0; i < j->number_procs; i++) {
-        process* proc = j->procs + i;
-        if (!proc->completed && !proc->stopped) {
-            return false;
-        }
+    return j->number_stopped + j->number_completed == j->number_procs;
+}
+
+bool job_completed(job* j) {
+    return j->number_completed == j->number_procs;
+}
+
+bool job_limited(job* j) {
+    return j->cpu_limit || j->memory_limit || j->pids_limit;
+}
+
+/*****************************
+ * Job table
+ *****************************/
+job_table jobs_table;
+
+#define JOBS_INITIAL_BUCKETS 64
+
+#define pgid_bucket(pgid) (&jobs_table.by_pgid[(size_t) (pgid) & (jobs_table.nbuckets - 1)])
+#define pid_bucket(pid) (&jobs_table.by_pid[(size_t) (pid) & (jobs_table.nbuckets - 1)])
+
+static void index_pgid(job* j) {
+    job** bucket;
+    if (j->pgid == 0) {
+        return; /* no job control: jobs share the shell group */
     }
+    bucket = pgid_bucket(j->pgid);
+    j->pgid_next = *bucket;
+    *bucket = j;
+}
 
-    return true;
+/* Processes stay in the pid index once completed, until their job is
+ * removed, for wait to find them; only the running ones are counted */
+static void index_pid(process* proc) {
+    process** bucket = pid_bucket(proc->pid);
+    proc->pid_next = *bucket;
+    *bucket = proc;
+    jobs_table.number_indexed++;
+    if (!proc->completed) {
+        jobs_table.number_pids++;
+    }
 }
 
-bool job_completed(job* j) {
-    int i;
-    for (i = 0; i < j->number_procs; i++) {
-        process* proc = j->procs + i;
+/* Link to proc in its pid bucket, NULL if it is not indexed */
+static process** pid_link(process* proc) {
+    process** link;
+    for (link = pid_bucket(proc->pid); *link; link = &(*link)->pid_next) {
+        if (*link == proc) {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+static void unindex_pid(process* proc) {
+    process** link = pid_link(proc);
+    if (link) {
+        *link = proc->pid_next;
+        jobs_table.number_indexed--;
         if (!proc->completed) {
-            return false;
+            jobs_table.number_pids--;
         }
     }
+}
 
-    return true;
+/* Double the buckets of both indexes and rebuild them */
+static void grow_indexes() {
+    job** old_pgid = jobs_table.by_pgid;
+    process** old_pid = jobs_table.by_pid;
+    size_t i, old_size = jobs_table.nbuckets;
+
+    jobs_table.nbuckets = old_size ? old_size * 2 : JOBS_INITIAL_BUCKETS;
+    jobs_table.by_pgid = calloc(jobs_table.nbuckets, sizeof(*jobs_table.by_pgid));
+    jobs_table.by_pid = calloc(jobs_table.nbuckets, sizeof(*jobs_table.by_pid));
+    jobs_table.number_pids = jobs_table.number_indexed = 0;
+
+    for (i = 0; i < old_size; i++) {
+        job* j, * next_job;
+        process* proc, * next_proc;
+        for (j = old_pgid[i]; j; j = next_job) {
+            next_job = j->pgid_next;
+            index_pgid(j);
+        }
+        for (proc = old_pid[i]; proc; proc = next_proc) {
+            next_proc = proc->pid_next;
+            index_pid(proc);
+        }
+    }
+    free(old_pgid);
+    free(old_pid);
+}
+
+/* Make j the latest job run */
+static void link_latest(job* j) {
+    j->older = jobs_table.latest;
+    j->newer = NULL;
+    if (jobs_table.latest) {
+        jobs_table.latest->newer = j;
+    }
+    jobs_table.latest = j;
+}
+
+static void unlink_latest(job* j) {
+    if (j->newer) {
+        j->newer->older = j->older;
+    } else {
+        jobs_table.latest = j->older;
+    }
+    if (j->older) {
+        j->older->newer = j->newer;
+    }
 }
 
 void put_job(job* new_job) {
-    struct job* j;
-    for (j = jobs_head; j->next; j = j->next);
-    j->next = new_job;
+    size_t i;
+
+    if (jobs_table.number_jobs >= jobs_table.nbuckets
+        || jobs_table.number_indexed + new_job->number_procs > jobs_table.nbuckets) {
+        grow_indexes();
+    }
+
+    /* launch order */
+    new_job->prev = jobs_table.last;
+    new_job->next = NULL;
+    if (jobs_table.last) {
+        jobs_table.last->next = new_job;
+    } else {
+        jobs_table.first = new_job;
+    }
+    jobs_table.last = new_job;
+    jobs_table.number_jobs++;
+
+    link_latest(new_job);
+    index_pgid(new_job);
+    for (i = 0; i < new_job->number_procs; i++) {
+        if (new_job->procs[i].pid > 0) {
+            index_pid(&new_job->procs[i]);
+        }
+    }
 }
 
 void remove_job(struct job* toRemove) {
-    struct job* j;
-    for (j = jobs_head; j->next; j = j->next) {
-        if (j->next == toRemove) {
-            j->next = toRemove->next;
-            release_job(toRemove);
+    job** link;
+    size_t i;
+
+    for (i = 0; i < toRemove->number_procs; i++) {
+        if (toRemove->procs[i].pid > 0) {
+            unindex_pid(&toRemove->procs[i]);
+        }
+    }
+    for (link = pgid_bucket(toRemove->pgid); toRemove->pgid && *link; link = &(*link)->pgid_next) {
+        if (*link == toRemove) {
+            *link = toRemove->pgid_next;
             break;
         }
     }
+    unlink_latest(toRemove);
+
+    if (toRemove->prev) {
+        toRemove->prev->next = toRemove->next;
+    } else {
+        jobs_table.first = toRemove->next;
+    }
+    if (toRemove->next) {
+        toRemove->next->prev = toRemove->prev;
+    } else {
+        jobs_table.last = toRemove->prev;
+    }
+    jobs_table.number_jobs--;
+
+    cgroup_remove(toRemove->cgroup, toRemove->cgroup_id);
+    toRemove->cgroup = -1;
+    release_job(toRemove);
+}
+
+void release_jobs() {
+    while (jobs_table.first) {
+        remove_job(jobs_table.first);
+    }
+    free(jobs_table.by_pgid);
+    free(jobs_table.by_pid);
+    memset(&jobs_table, 0, sizeof(jobs_table));
 }
 
 job* find_job(int pgid) {
     job* j;
-    if (pgid == 0) return NULL;
-    for (j = jobs_head->next; j; j = j->next) {
+    if (pgid == 0 || !jobs_table.nbuckets) return NULL;
+    for (j = *pgid_bucket(pgid); j; j = j->pgid_next) {
         if (j->pgid == pgid) {
             return j;
         }
@@ -231,24 +925,33 @@ job* find_job(int pgid) {
     return NULL;
 }
 
+job* find_job_by_pid(int pid) {
+    process* proc, * found = NULL;
+    if (pid <= 0 || !jobs_table.nbuckets) return NULL;
+    for (proc = *pid_bucket(pid); proc; proc = proc->pid_next) {
+        if (proc->pid == pid && (!found || !proc->completed)) {
+            found = proc; /* the running one if the pid was reused */
+        }
+    }
+    return found ? found->job : NULL;
+}
+
 job* find_latest_job(job_search search) {
-    job* j, * latest;
-    for (latest = j = jobs_head->next; j; j = j->next) {
-        if (j->time_run > latest->time_run) {
-            bool stopped = job_stopped(j);
-            if((search == SEARCH_RUNNING && stopped)
-               ||search == SEARCH_STOPPED && !stopped) {
-                continue;
-            } else {
-                latest = j;
-            }
+    job* j;
+    /* usually the latest job itself, older ones are only checked when filtered out */
+    for (j = jobs_table.latest; j; j = j->older) {
+        bool stopped = job_stopped(j) && !job_completed(j);
+        if (search == SEARCH_ALL
+            || (search == SEARCH_STOPPED && stopped)
+            || (search == SEARCH_RUNNING && !stopped)) {
+            return j;
         }
     }
-    return latest;
+    return NULL;
 }
 
 bool continue_job(struct job* job) {
-    if (killpg(job->pgid, SIGCONT) < 0) {
+    if (!job_signal(job, SIGCONT)) {
         return false;
     } else {
         int i;
@@ -256,36 +959,194 @@ bool continue_job(struct job* job) {
             process* proc = &job->procs[i];
             proc->stopped = false;
         }
+        job->number_stopped = 0;
         job->notified = false;
         job->time_run = time(NULL);
+        unlink_latest(job);
+        link_latest(job);
         return true;
     }
 }
 
-bool jobs_update_status(int pid, int status) {
-    job* j;
-    if (pid <= 0) { return false; }
-    for (j = jobs_head; j; j = j->next) {
-        int i;
+static void complete_process(process* proc, int status, const struct rusage* usage) {
+    job* j = proc->job;
+    if (proc->completed) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &proc->finished);
+    unwatch_process(proc);
+    if (usage) {
+        proc->usage = *usage;
+    }
+    if (proc->pid > 0 && jobs_table.nbuckets && pid_link(proc)) {
+        jobs_table.number_pids--; /* still indexed, no longer running */
+    }
+    if (proc->stopped) {
+        proc->stopped = false;
+        j->number_stopped--;
+    }
+    proc->completed = true;
+    proc->status = status;
+    j->number_completed++;
+    if (job_completed(j)) {
+        jobserver_give(j->token);
+        j->token = -1;
+        stop_deadline(j);
+    }
+}
 
-        for (i = 0; i < j->number_procs; i++) {
-            process* proc = &j->procs[i];
+bool jobs_update_status(int pid, int status, const struct rusage* usage) {
+    process* proc;
+    if (pid <= 0 || !jobs_table.nbuckets) { return false; }
 
-            if (pid == proc->pid) {
+    for (proc = *pid_bucket(pid); proc; proc = proc->pid_next) {
+        if (pid == proc->pid && !proc->completed) {
+            if (!WIFSTOPPED(status)) {
+                complete_process(proc, status, usage);
+            } else if (!proc->stopped) {
                 proc->status = status;
-                if (WIFSTOPPED(status)) {
-                    proc->stopped = true;
-                } else {
-                    proc->completed = true;
-                }
-                return true;
+                proc->stopped = true;
+                proc->job->number_stopped++;
             }
+            return true;
         }
     }
 
     return false;
 }
 
+bool job_signal(struct job* job, int signo) {
+    bool signaled = false, group = false;
+    size_t i;
+
+    for (i = 0; i < job->number_procs; i++) {
+        process* proc = &job->procs[i];
+        if (proc->completed || proc->pid <= 0) {
+            continue;
+        }
+#ifdef SYS_pidfd_send_signal
+        if (proc->pidfd >= 0) {
+            signaled |= syscall(SYS_pidfd_send_signal, proc->pidfd, signo, NULL, 0) == 0;
+            continue;
+        }
+#endif
+        /* no pidfd: through the process group, which may have been reused */
+        if (job->pgid > 0) {
+            group = true;
+        } else {
+            signaled |= kill(proc->pid, signo) == 0;
+        }
+    }
+    if (group) {
+        signaled |= killpg(job->pgid, signo) == 0;
+    }
+    return signaled;
+}
+
+void job_set_priority(struct job* job, bool background) {
+    int nice = 0;
+    size_t i;
+
+    if (background ? !priority_background(&nice) : !job->demoted) {
+        return;
+    }
+    for (i = 0; i < job->number_procs; i++) {
+        process* proc = &job->procs[i];
+        if (proc->pid > 0 && !proc->completed) {
+            priority_set(proc->pid, background, nice);
+        }
+    }
+    if (job->pgid > 0) {
+        priority_set_group(job->pgid, background, nice);
+    }
+    job->demoted = background;
+}
+
+bool reap_process(process* proc) {
+    siginfo_t info;
+    struct rusage usage;
+
+    /* waitid() is the only wait with a pidfd, the raw call returns the usage */
+    info.si_pid = 0;
+    if (proc->pidfd < 0
+        || syscall(SYS_waitid, P_PIDFD, proc->pidfd, &info, WEXITED | WNOHANG, &usage) < 0
+        || info.si_pid == 0) {
+        return false;
+    }
+    complete_process(proc, siginfo_status(&info), &usage);
+    return true;
+}
+
+bool reap_children() {
+    bool changed = false;
+    siginfo_t info;
+
+    /* stops are only told by SIGCHLD, the stopped child is not reaped */
+    info.si_pid = 0;
+    while (waitid(P_ALL, 0, &info, WSTOPPED | WNOHANG) == 0 && info.si_pid != 0) {
+        changed |= jobs_update_status(info.si_pid, siginfo_status(&info), NULL);
+        info.si_pid = 0;
+    }
+
+    if (!have_pidfd || processes_without_pidfd > 0) {
+        struct rusage usage;
+        int pid, status;
+        while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+            changed |= jobs_update_status(pid, status, &usage);
+        }
+    }
+    return changed;
+}
+
+int job_exit_status(job* j) {
+    int status;
+    if (j->number_procs == 0) {
+        return 0;
+    }
+    if (j->timeout_signal) {
+        return j->timeout_signal == SIGKILL ? 128 + SIGKILL : 124;
+    }
+    status = j->procs[j->number_procs - 1].status;
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/* Seconds from start to end */
+static double elapsed(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+#define TIMEVAL_SECONDS(tv) ((tv).tv_sec + (tv).tv_usec / 1e6)
+
+void print_job_usage(job* j, FILE* out) {
+    struct timespec now;
+    size_t i, k;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(out, "%9s %9s %9s %9s %7s %7s %7s %7s  %s\n",
+            "real", "user", "sys", "maxrss", "vcsw", "ivcsw", "minflt", "majflt", "command");
+
+    for (i = 0; i < j->number_procs; i++) {
+        process* proc = &j->procs[i];
+        struct rusage* ru = &proc->usage;
+
+        if (proc->completed) {
+            fprintf(out, "%8.3fs %8.3fs %8.3fs %8ldk %7ld %7ld %7ld %7ld ",
+                    elapsed(&proc->started, &proc->finished),
+                    TIMEVAL_SECONDS(ru->ru_utime), TIMEVAL_SECONDS(ru->ru_stime),
+                    ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_minflt, ru->ru_majflt);
+        } else {
+            /* usage is only known once the process is reaped */
+            fprintf(out, "%8.3fs %9s %9s %9s %7s %7s %7s %7s ",
+                    elapsed(&proc->started, &now), "-", "-", "-", "-", "-", "-", "-");
+        }
+        for (k = 0; k < proc->argc; k++) {
+            fprintf(out, " %s", proc->argv[k]);
+        }
+        fprintf(out, "\n");
+    }
+    cgroup_print_usage(j->cgroup, j->cgroup_id, out);
+}
+
 const char* job_str_status(job* j) {
     assert(j);
     if (job_completed(j))
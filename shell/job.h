@@ -24,31 +24,82 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include "tparse.h"
 #include <time.h>
+#include <sys/resource.h>
 
 /* Struct representing a single process from a job */
-typedef struct {
+typedef struct process {
     char** argv;                /* Process arguments, including program name */
-    size_t argc;                /* Number of arguments */
+    size_t argc;                /* Number of arguments, 0 for assignments only */
+    char** assigns;             /* Leading NAME=value words, before argv */
+    size_t nassigns;            /* Number of assignments */
+    char* cpus;                 /* CPU list the process is pinned to, NULL if none */
     pid_t pid;                  /* Process id */
+    int pidfd;                  /* pidfd_open() descriptor while running, -1 otherwise */
     bool completed, stopped;    /* Process status flag */
     int status;                 /* Returned status on exit */
+    struct job* job;            /* Job the process belongs to */
+    struct process* pid_next;   /* Next process in the same pid bucket */
+    struct timespec started;    /* Monotonic time the process was launched */
+    struct timespec finished;   /* Monotonic time the process was reaped */
+    struct rusage usage;        /* Resources used, set once completed */
 } process;
 
-/* Struct representing a single job in a linked list */
+/* Struct representing a single job in the job table */
 typedef struct job {
-    struct job* next;           /* Next job in list */
+    struct job* next, * prev;   /* Jobs in launch order */
+    struct job* older, * newer; /* Jobs ordered by the last time they were run */
+    struct job* pgid_next;      /* Next job in the same pgid bucket */
     process* procs;             /* List of processes */
     size_t number_procs;        /* Number of processes */
+    size_t number_stopped;      /* Processes stopped (and not completed) */
+    size_t number_completed;    /* Processes completed */
     char* command_line;         /* Command line to run this job */
     int pgid;                   /* Process group id, equals shell pid if foreground */
     bool notified;              /* Stopped job has already been notified */
+    bool reported;              /* Completion was notified, kept for wait only */
     bool background;            /* Is running in background? */
+    bool timed;                 /* Report resource usage when done (time prefix) */
+    double timeout;             /* Seconds the job may run, 0 for none, -1 without prefix */
+    double kill_after;          /* Seconds between SIGTERM and SIGKILL on the deadline */
+    int timer;                  /* timerfd of the deadline while running, -1 if none */
+    int timeout_signal;         /* Last signal sent on the deadline, 0 if none */
+    const char* cpu_limit;      /* limit prefix values, NULL for the parent's */
+    const char* memory_limit;
+    const char* pids_limit;
+    int cgroup;                 /* Directory of the job's cgroup, -1 if none */
+    unsigned cgroup_id;         /* Number naming the job's cgroup */
+    char* cpu_list;             /* CPUs of the pin prefix or automatic placement */
+    bool spread;                /* One CPU of cpu_list per process (pin -s) */
+    bool demoted;               /* Runs with the background priority */
     time_t time_run;            /* Last time the job was run or continued */
     int in, out, err;           /* Input, output and error file descriptors */
+    int token;                  /* Jobserver token held while running, -1 if none */
 } job;
 
-/* Initialize a job struct from a (foo shell) pipeline object */
-job* job_from_pipeline(pipeline_t* pipeline, char* command_line);
+/* The shell jobs, indexed by pgid and by pid of their processes */
+typedef struct {
+    job* first, * last;         /* Jobs in launch order (next/prev) */
+    job* latest;                /* Last job run or continued, older ones follow */
+    job** by_pgid;              /* Hash buckets of jobs by pgid */
+    process** by_pid;           /* Hash buckets of processes by pid */
+    size_t nbuckets;            /* Buckets of each index, a power of two */
+    size_t number_jobs;         /* Jobs in the table */
+    size_t number_pids;         /* Running or stopped processes */
+    size_t number_indexed;      /* Processes in the pid index */
+} job_table;
+
+/* Table of child jobs */
+extern job_table jobs_table;
+
+/* Variable holding the deadline of foreground jobs run without timeout */
+#define TIMEOUT_VAR "ROYALDUTCH_TIMEOUT"
+
+/* Seconds the job gets between SIGTERM and SIGKILL unless timeout -k */
+#define TIMEOUT_KILL_AFTER 5.0
+
+/* Initialize a job struct from a (foo shell) pipeline object,
+ * NULL if its redirections could not be opened */
+job* job_from_pipeline(pipeline_t* pipeline);
 
 /* Launch all process from the job */
 void launch_job(struct job* job);
@@ -62,15 +113,25 @@ bool job_stopped(job* j);
 /* Return true if all job's processes are marked completed, false otherwise */
 bool job_completed(job* j);
 
-/* Put job on the end of jobs list */
+/* Return true if the job has limits (limit prefix) it must not run without */
+bool job_limited(job* j);
+
+/* Put a launched job on the end of the job table */
 void put_job(job* new_job);
 
-/* Remove job from jobs list */
+/* Remove job from the job table, and its cgroup, and release it */
 void remove_job(struct job* toRemove);
 
-/* Find job by pgid in jobs list */
+/* Remove and release every job */
+void release_jobs();
+
+/* Find job by pgid in the job table */
 job* find_job(int pgid);
 
+/* Find the job of a process by pid in the job table, completed ones
+ * included until their job is removed */
+job* find_job_by_pid(int pid);
+
 /* Enum used to filter jobs on find_lastest_job() */
 typedef enum {
     SEARCH_ALL,
@@ -78,14 +139,45 @@ typedef enum {
     SEARCH_RUNNING
 } job_search;
 
-/* Find the job with latest time_run, filter by the job_search enum */
+/* Find the job run or continued last, filter by the job_search enum */
 job* find_latest_job(job_search search);
 
 /* Continue the stopped job's processes */
 bool continue_job(struct job* job);
 
-/* Mark job and process as stopped, completed etc. */
-bool jobs_update_status(int pid, int status);
+/* Send signo once to each running process of a job, through its pidfd
+ * (a reused pid is never hit), or through the process group of the job
+ * (the pid when it has none) for the processes without one. Return false
+ * if none was signaled. */
+bool job_signal(struct job* job, int signo);
+
+/* Give the running processes of a job the background priority (see
+ * priority.h) if the policy is on, or back the one of the shell if it
+ * was demoted. Best effort. */
+void job_set_priority(struct job* job, bool background);
+
+/* Mark job and process as stopped, completed etc.
+ * usage (from wait4, may be NULL) is kept for completed processes */
+bool jobs_update_status(int pid, int status, const struct rusage* usage);
+
+/* Collect the exit of proc, whose pidfd is readable, without waiting.
+ * Return true if it completed. */
+bool reap_process(process* proc);
+
+/* Collect the stopped children on SIGCHLD, without waiting; exits are
+ * collected through the pidfds (reap_process()) unless the kernel has
+ * none or a process could not get one. Return true if a job changed. */
+bool reap_children();
+
+/* Exit status of a completed job: the one of its last process,
+ * 128 + signal number if it was killed, 124 if it ran past its deadline
+ * (137 if it took a SIGKILL) */
+int job_exit_status(job* j);
+
+/* Print the time and resources used by each process of a job,
+ * processes still running only show their elapsed time, then the ones
+ * of its cgroup if it has one */
+void print_job_usage(job* j, FILE* out);
 
 /* Get a string representing job status */
 const char* job_str_status(job* j);
@@ -0,0 +1,179 @@
+/* jobserver.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobserver.h"
+#include "event.h"
+#include "vars.h"
+
+/* Pipe shared with the make processes (inherited, not close-on-exec) */
+static int jobserver_read = -1, jobserver_write = -1;
+
+/* Private non-blocking open of the read end: the shell never blocks in
+ * read() while another process takes the last token, and the flag does
+ * not leak to the file description the children use */
+static int jobserver_poll = -1;
+
+/* Descriptor of the named pipe of the jobserver (fifo:PATH), opened by
+ * the shell, -1 if the pipe is inherited */
+static int jobserver_fifo = -1;
+
+/* Find --jobserver-auth=R,W (make 4.x) or --jobserver-auth=fifo:PATH
+ * (make 4.4 and later default) in MAKEFLAGS, false if there is none or
+ * it cannot be used. The last one counts, as in make. */
+static bool parse_makeflags(const char* makeflags, int* rfd, int* wfd) {
+    const char* auth = NULL, * next;
+
+    for (next = makeflags; next && (next = strstr(next, "--jobserver-auth=")); next++) {
+        auth = next + strlen("--jobserver-auth=");
+    }
+    if (!auth) {
+        return false;
+    }
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        char* path = strndup(auth + 5, strcspn(auth + 5, " "));
+        jobserver_fifo = open(path, O_RDWR | O_CLOEXEC);
+        free(path);
+        *rfd = *wfd = jobserver_fifo;
+        return jobserver_fifo >= 0;
+    }
+    if (sscanf(auth, "%d,%d", rfd, wfd) != 2) {
+        return false;
+    }
+    return fcntl(*rfd, F_GETFD) >= 0 && fcntl(*wfd, F_GETFD) >= 0;
+}
+
+/* Copy of makeflags without its jobserver options, which would not name
+ * the pool of the shell */
+static char* strip_jobserver(const char* makeflags) {
+    char* flags = malloc(strlen(makeflags) + 1), * out = flags;
+    const char* word = makeflags;
+
+    while (*word) {
+        size_t length = strcspn(word, " ");
+        if (strncmp(word, "--jobserver-auth=", strlen("--jobserver-auth=")) != 0
+            && strncmp(word, "--jobserver-fds=", strlen("--jobserver-fds=")) != 0) {
+            memcpy(out, word, length);
+            out += length;
+            if (word[length]) {
+                *out++ = ' ';
+            }
+        }
+        word += length;
+        word += strspn(word, " ");
+    }
+    while (out > flags && out[-1] == ' ') {
+        out--;
+    }
+    *out = '\0';
+    return flags;
+}
+
+void jobserver_init() {
+    const char* size = getenv(JOBSERVER_ENV);
+    const char* makeflags = var_get("MAKEFLAGS");
+    char path[32];
+    long tokens;
+    int fds[2];
+
+    if (!size || !*size) {
+        return;
+    }
+
+    if (!parse_makeflags(makeflags, &jobserver_read, &jobserver_write)) {
+        char* flags, * stripped;
+
+        /* a pool of our own, the size of the machine by default */
+        tokens = atol(size);
+        if (tokens <= 0) {
+            tokens = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if (pipe(fds) < 0) {
+            jobserver_release();
+            return;
+        }
+        jobserver_read = fds[0];
+        jobserver_write = fds[1];
+        for (; tokens > 0; tokens--) {
+            (void) !write(jobserver_write, "+", 1);
+        }
+
+        stripped = strip_jobserver(makeflags ? makeflags : "");
+        flags = malloc(strlen(stripped) + 64);
+        sprintf(flags, "%s -j --jobserver-auth=%d,%d", stripped, jobserver_read, jobserver_write);
+        var_export("MAKEFLAGS", flags);
+        free(flags);
+        free(stripped);
+    }
+
+    sprintf(path, "/proc/self/fd/%d", jobserver_read);
+    jobserver_poll = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (jobserver_poll < 0) {
+        jobserver_release();
+    }
+}
+
+void jobserver_release() {
+    if (jobserver_poll >= 0) {
+        close(jobserver_poll);
+    }
+    if (jobserver_fifo >= 0) {
+        close(jobserver_fifo);
+    }
+    jobserver_poll = jobserver_read = jobserver_write = jobserver_fifo = -1;
+}
+
+bool jobserver_enabled() {
+    return jobserver_poll >= 0;
+}
+
+int jobserver_take() {
+    unsigned char token;
+
+    if (jobserver_poll < 0) {
+        return -1;
+    }
+    while (true) {
+        ssize_t n = read(jobserver_poll, &token, 1);
+        if (n == 1) {
+            return token;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            return -1; /* every writer is gone */
+        }
+        if (event_wait(jobserver_poll, -1) < 0) {
+            return -1;
+        }
+    }
+}
+
+void jobserver_give(int token) {
+    unsigned char byte = (unsigned char) token;
+    if (token >= 0 && jobserver_write >= 0) {
+        while (write(jobserver_write, &byte, 1) < 0 && errno == EINTR);
+    }
+}
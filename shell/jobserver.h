@@ -0,0 +1,49 @@
+/* jobserver.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_JOBSERVER_H
+#define IMP_JOBSERVER_H
+
+#include <stdbool.h>
+
+/* Environment variable that turns the jobserver on: a number of tokens,
+ * or any other value for one token per online CPU */
+#define JOBSERVER_ENV "ROYALDUTCH_JOBSERVER"
+
+/* Set up the token pool if JOBSERVER_ENV is set: join the jobserver of
+ * MAKEFLAGS when the shell runs under make, otherwise create a pipe of
+ * tokens and export it through MAKEFLAGS (--jobserver-auth=R,W, GNU make
+ * 4.x), so that every make run from the shell shares the same pool */
+void jobserver_init();
+
+/* Close the jobserver descriptors */
+void jobserver_release();
+
+/* True when background jobs take tokens */
+bool jobserver_enabled();
+
+/* Take a token from the pool, serving the event loop (and so reaping
+ * children, which gives their tokens back) until one is available.
+ * Return the token, or -1 if the jobserver is off or broken. */
+int jobserver_take();
+
+/* Give back a token returned by jobserver_take() */
+void jobserver_give(int token);
+
+#endif
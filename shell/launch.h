@@ -0,0 +1,53 @@
+/* launch.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMP_LAUNCH_H
+#define IMP_LAUNCH_H
+
+#include "job.h"
+#include "builtin.h"
+
+/* The launch engine is chosen at build time: posix_spawn() by default,
+ * or the classic fork()+exec path when built with -DLAUNCH_FORK
+ * (make LAUNCH=fork). posix_spawn() needs glibc's tcsetpgrp file action
+ * to hand the terminal to a foreground job, otherwise fork is used. */
+#if !defined(LAUNCH_FORK) && !(defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 35))
+#define LAUNCH_FORK
+#endif
+
+/* Shell running the executable files that are not programs (ENOEXEC) */
+#define SCRIPT_SHELL "/bin/sh"
+
+/* Arguments of SCRIPT_SHELL to run path, a script without #!, with the
+ * arguments of argv, like execvp() does (malloc'd, the strings are not
+ * copied) */
+char** script_argv(const char* path, char* const* argv);
+
+/* Start proc as part of job, reading from in_file and writing to out_file,
+ * through the zygote when it runs (see zygote.h), forked when the job has
+ * a cgroup (see cgroup.h), which the child joins before exec.
+ * The child joins job->pgid (or becomes its leader when pgid is 0).
+ * Returns the child pid, or -1 with errno set if the program could not be
+ * executed; in that case no child is left behind. */
+pid_t spawn_process(struct job* job, process* proc, int in_file, int out_file);
+
+/* Start proc in a forked child running builtin b (no exec), with the
+ * same process group and descriptors setup as spawn_process(). */
+pid_t spawn_builtin(struct job* job, process* proc, const builtin* b, int in_file, int out_file);
+
+#endif
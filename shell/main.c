@@ -32,24 +32,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "job.h"
 #include "royaldutch.h"
 
-/* Condition for running builtin called <name> (assumes job* job) */
-#define BUILTIN_CONDITION(name) (job->number_procs > 0 && strcmp(#name, job->procs[0].argv[0]) == 0)
-
-/* Runs builtin_<name> or builtin_help_<name> (only to be used in main) */
-#define BUILTIN_ON_FUNCTION(name) {if(BUILTIN_CONDITION(name)) {builtin_ ## name(job); release_job(job); continue;} \
-                                   if(BUILTIN_CONDITION(help)) {builtin_help_ ## name(); }}
-
 int main(int argc, char** argv) {
-    buffer_t* command_line = new_command_line();
-    shell_init();
+    buffer_t* command_line;
+    bool interactive = false;
+
+    /* royaldutch -c <command> | royaldutch <script> | royaldutch */
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        command_line = new_command_text(argv[2], strlen(argv[2]));
+    } else if (argc > 1 && argv[1][0] != '-') {
+        command_line = new_command_file(argv[1]);
+        if (!command_line) {
+            return 127;
+        }
+    } else if (argc > 1) {
+        fprintf(stderr, "usage: %s [-c command | script]\n", argv[0]);
+        return 2;
+    } else {
+        command_line = new_command_line();
+        interactive = true;
+    }
+    shell_init(interactive);
+    shell_input = command_line;
 
-    while (true) {
+    while (!exit_requested) {
         int read;
-        job* job;
+        pipeline_t* list;
 
         notify_background_jobs(); /* Update and notify of background jobs */
-        read = prompt(command_line, &job);
-        if (!job) {
+        read = prompt(command_line, &list);
+        if (!list) {
             if (read == 0) {
                 break;  /* exit on empty command */
             } else {
@@ -57,37 +68,11 @@ int main(int argc, char** argv) {
             }
         }
 
-        /* Try running builtins */
-        BUILTIN_ON_FUNCTION(cd);
-        BUILTIN_ON_FUNCTION(fg);
-        BUILTIN_ON_FUNCTION(bg);
-        BUILTIN_ON_FUNCTION(jobs);
-        if (BUILTIN_CONDITION(exit)) { break; }
-        if (BUILTIN_CONDITION(help)) {
-            /* builtin_help_<name>() functions have already been run for each of the
-             * previous builtins, except for exit, here print it and end the job */
-            builtin_help_exit();
-            fflush(stdout);
-            release_job(job);
-            continue;
-        }
-
-        /* Put job on the list and launch it*/
-        put_job(job);
-        launch_job(job);
-
-        /* Launching jobs resets signal handlers, restore them here */
-        set_signals(SIG_IGN, false);
-
-        if (job->background) {
-            printf("[%d] started\n", job->pgid);
-        } else {
-            wait_foreground_job(job);
-        }
+        run_list(list);
     }
 
     shell_release();
     release_command_line(command_line);
 
-    return EXIT_SUCCESS;
+    return last_status;
 }
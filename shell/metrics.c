@@ -0,0 +1,273 @@
+/* metrics.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "event.h"
+#include "job.h"
+#include "hashtab.h"
+
+/* Upper bounds of the histogram buckets in microseconds, +Inf follows */
+static const unsigned long bucket_bounds[] = {
+    10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 10000000
+};
+#define NBUCKETS (sizeof(bucket_bounds) / sizeof(bucket_bounds[0]))
+
+typedef struct {
+    unsigned long buckets[NBUCKETS + 1]; /* Per bucket, not cumulative */
+    uint64_t sum;                        /* Nanoseconds */
+    unsigned long count;
+} histogram;
+
+/* Names and help of the counters and histograms, in enum order */
+static const char* counter_names[METRIC_COUNTERS][2] = {
+    {"royaldutch_jobs_launched_total", "Jobs launched."},
+    {"royaldutch_spawns_total", "Processes started."},
+    {"royaldutch_exec_failures_total", "Commands that could not be executed."}
+};
+static const char* histogram_names[METRIC_HISTOGRAMS][2] = {
+    {"royaldutch_parse_seconds", "Time to parse a command line."},
+    {"royaldutch_spawn_seconds", "Time to start a process."},
+    {"royaldutch_wait_seconds", "Time spent waiting for a foreground job."}
+};
+
+bool metrics_enabled;
+unsigned long metrics_counters[METRIC_COUNTERS];
+
+static histogram histograms[METRIC_HISTOGRAMS];
+/* Launches per command name, never cleared unlike the command hash (hash
+ * -r, PATH), as Prometheus counters do not go backwards */
+static hashtab* commands;
+static int metrics_socket = -1;
+static char* metrics_path;
+
+void metrics_observe(metrics_histogram which, uint64_t start) {
+    histogram* h = &histograms[which];
+    uint64_t elapsed = trace_now() - start;
+    size_t i;
+
+    for (i = 0; i < NBUCKETS && elapsed > bucket_bounds[i] * 1000u; i++);
+    h->buckets[i]++;
+    h->sum += elapsed;
+    h->count++;
+}
+
+void metrics_command(const char* name) {
+    unsigned long* count;
+
+    if (!commands) {
+        commands = new_hashtab(free);
+    }
+    count = hashtab_get(commands, name);
+    if (!count) {
+        count = calloc(1, sizeof(unsigned long));
+        hashtab_put(commands, name, count);
+    }
+    (*count)++;
+}
+
+/* Write a label value, escaped */
+static void print_label(FILE* out, const char* value) {
+    for (; *value; value++) {
+        if (*value == '\\' || *value == '"') {
+            fprintf(out, "\\%c", *value);
+        } else if (*value == '\n') {
+            fprintf(out, "\\n");
+        } else {
+            fputc(*value, out);
+        }
+    }
+}
+
+/* One sample per command name that was launched */
+static void print_command(hashtab_entry* entry, void* data) {
+    unsigned long* count = entry->value;
+    FILE* out = data;
+
+    fprintf(out, "royaldutch_commands_total{command=\"");
+    print_label(out, entry->key);
+    fprintf(out, "\"} %lu\n", *count);
+}
+
+/* The metrics in the Prometheus text format */
+static void print_metrics(FILE* out) {
+    size_t i, j;
+
+    fprintf(out, "# HELP royaldutch_jobs Jobs in the job table.\n"
+            "# TYPE royaldutch_jobs gauge\n"
+            "royaldutch_jobs %lu\n", (unsigned long) jobs_table.number_jobs);
+    fprintf(out, "# HELP royaldutch_processes Processes running or stopped.\n"
+            "# TYPE royaldutch_processes gauge\n"
+            "royaldutch_processes %lu\n", (unsigned long) jobs_table.number_pids);
+
+    for (i = 0; i < METRIC_COUNTERS; i++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", counter_names[i][0],
+                counter_names[i][1], counter_names[i][0], counter_names[i][0], metrics_counters[i]);
+    }
+
+    for (i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const char* name = histogram_names[i][0];
+        histogram* h = &histograms[i];
+        unsigned long cumulative = 0;
+
+        fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_names[i][1], name);
+        for (j = 0; j < NBUCKETS; j++) {
+            cumulative += h->buckets[j];
+            fprintf(out, "%s_bucket{le=\"%g\"} %lu\n", name, bucket_bounds[j] / 1e6, cumulative);
+        }
+        fprintf(out, "%s_bucket{le=\"+Inf\"} %lu\n", name, h->count);
+        fprintf(out, "%s_sum %.9f\n%s_count %lu\n", name, h->sum / 1e9, name, h->count);
+    }
+
+    fprintf(out, "# HELP royaldutch_commands_total Commands launched, by name.\n"
+            "# TYPE royaldutch_commands_total counter\n");
+    if (commands) {
+        hashtab_foreach(commands, print_command, out);
+    }
+}
+
+/* Response being written to a client */
+typedef struct {
+    char* text;
+    size_t length, sent;
+} response;
+
+/* Write what the client socket takes of its response, without blocking,
+ * and hang up once it is all sent or the client is gone. The rest waits
+ * for the socket to be writable, a slow client never holds the shell. */
+static void write_event(int client, void* data) {
+    response* r = data;
+    ssize_t written = 0;
+
+    while (r->sent < r->length
+           && (written = send(client, r->text + r->sent, r->length - r->sent, MSG_NOSIGNAL)) > 0) {
+        r->sent += (size_t) written;
+    }
+    if (r->sent < r->length && written < 0 && (errno == EAGAIN || errno == EINTR)) {
+        event_watch_output(client, write_event, r);
+        return;
+    }
+    event_unwatch(client);
+    close(client);
+    free(r->text);
+    free(r);
+}
+
+/* A client sent its request (which does not matter) or hung up: answer
+ * with the metrics. The text is only built here, serving costs nothing
+ * to the prompt and launches. */
+static void client_event(int client, void* data) {
+    char request[1024], * body = NULL;
+    size_t length = 0;
+    response* r;
+    FILE* out;
+    int n;
+
+    (void) !recv(client, request, sizeof(request), 0);
+    out = open_memstream(&body, &length);
+    if (!out) {
+        event_unwatch(client);
+        close(client);
+        return;
+    }
+    print_metrics(out);
+    fclose(out);
+
+    r = malloc(sizeof(response));
+    r->text = malloc(length + 128);
+    n = sprintf(r->text, "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %lu\r\n\r\n", (unsigned long) length);
+    memcpy(r->text + n, body, length);
+    r->length = length + (size_t) n;
+    r->sent = 0;
+    free(body);
+    write_event(client, r);
+}
+
+/* A client connected, answer it once it sent its request */
+static void metrics_event(int fd, void* data) {
+    int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client >= 0) {
+        event_watch(client, client_event, NULL);
+    }
+}
+
+void metrics_init() {
+    const char* path = getenv(METRICS_ENV);
+    struct sockaddr_un address;
+    struct stat st;
+
+    if (!path || !*path) {
+        return;
+    }
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: %s: path too long\n", METRICS_ENV, path);
+        return;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    /* the socket of a shell that did not exit cleanly */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    metrics_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (metrics_socket < 0
+        || bind(metrics_socket, (struct sockaddr*) &address, sizeof(address)) < 0
+        || listen(metrics_socket, 8) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", METRICS_ENV, path, strerror(errno));
+        if (metrics_socket >= 0) {
+            close(metrics_socket);
+        }
+        metrics_socket = -1;
+        return;
+    }
+    metrics_path = strdup(path);
+    metrics_enabled = true;
+    event_watch(metrics_socket, metrics_event, NULL);
+}
+
+void metrics_release() {
+    if (metrics_socket < 0) {
+        return;
+    }
+    event_unwatch(metrics_socket);
+    close(metrics_socket);
+    unlink(metrics_path);
+    free(metrics_path);
+    metrics_socket = -1;
+    metrics_path = NULL;
+    metrics_enabled = false;
+    if (commands) {
+        release_hashtab(commands);
+        commands = NULL;
+    }
+}
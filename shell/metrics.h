@@ -0,0 +1,81 @@
+/* metrics.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_METRICS_H
+#define IMP_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+/* Environment variable naming the Unix socket the metrics are served on */
+#define METRICS_ENV "ROYALDUTCH_METRICS"
+
+/* Counters, incremented whether metrics are served or not */
+typedef enum {
+    METRIC_JOBS,                /* Jobs launched */
+    METRIC_SPAWNS,              /* Processes started */
+    METRIC_EXEC_FAILURES,       /* Commands that could not be executed */
+    METRIC_COUNTERS
+} metrics_counter;
+
+/* Latency histograms */
+typedef enum {
+    METRIC_PARSE,               /* Parsing a command line */
+    METRIC_SPAWN,               /* Starting a process */
+    METRIC_WAIT,                /* Waiting for a foreground job */
+    METRIC_HISTOGRAMS
+} metrics_histogram;
+
+/* The metrics are served, only checked by the macros below */
+extern bool metrics_enabled;
+
+extern unsigned long metrics_counters[METRIC_COUNTERS];
+
+/* Listen on the METRICS_ENV socket, if set, from the event loop: each
+ * connection gets the metrics in the Prometheus text format (as an HTTP
+ * response, curl --unix-socket reads it) and is closed */
+void metrics_init();
+
+/* Close and remove the socket */
+void metrics_release();
+
+/* Add the time from start to now to histogram */
+void metrics_observe(metrics_histogram histogram, uint64_t start);
+
+/* Count one more launch of the command name, builtins included */
+void metrics_command(const char* name);
+
+/* Count one more of counter */
+#define METRICS_COUNT(counter) (metrics_counters[counter]++)
+
+/* Count a launch of command name, only while metrics are served: the
+ * counts are kept per name */
+#define METRICS_COMMAND(name) \
+    do { if (metrics_enabled) { metrics_command(name); } } while (0)
+
+/* Time of the beginning of a measure, 0 when metrics are off */
+#define METRICS_BEGIN() (metrics_enabled ? trace_now() : 0)
+
+/* Add the time since METRICS_BEGIN() to histogram */
+#define METRICS_END(histogram, start) \
+    do { if (metrics_enabled) { metrics_observe(histogram, start); } } while (0)
+
+#endif
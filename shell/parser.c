@@ -19,9 +19,12 @@
 */
 
 #include <stdlib.h>
-#include "foosh.h"
+#include "tparse.h"
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "debug.h"
 
 
@@ -35,12 +38,76 @@ buffer_t *new_command_line (void)
   command_line = malloc (sizeof(buffer_t));
   sysfault (!command_line, NULL);
   command_line->size = BUFFER_STEP;
+  command_line->length = 0;
   command_line->buffer = malloc (BUFFER_STEP *sizeof(char));
-  if (command_line->buffer == NULL)
+  command_line->ahead = malloc (READ_AHEAD *sizeof(char));
+  if (command_line->buffer == NULL || command_line->ahead == NULL)
     {
+      free (command_line->buffer);
+      free (command_line->ahead);
       free (command_line);
       sysfault (1, NULL);
     }
+  command_line->buffer[0] = '\0';
+  command_line->fd = STDIN_FILENO;
+  command_line->ahead_start = 0;
+  command_line->ahead_end = 0;
+  command_line->text = NULL;
+  command_line->mapped = 0;
+  return command_line;
+}
+
+buffer_t *new_command_text (char *text, size_t size)
+{
+  buffer_t *command_line;
+  command_line = calloc (1, sizeof(buffer_t));
+  sysfault (!command_line, NULL);
+  command_line->fd = -1;
+  command_line->text = text;
+  command_line->text_size = size;
+  command_line->buffer = text;
+  return command_line;
+}
+
+buffer_t *new_command_file (const char *path)
+{
+  buffer_t *command_line;
+  struct stat st;
+  size_t mapped;
+  char *text;
+  int fd;
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  sysfault (fd < 0, NULL);
+  if (fstat (fd, &st) < 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  /* Reserve one byte more than the file, in anonymous memory, so
+     that the last line can be terminated even if the file fills its
+     last page; then map the file privately over it. Writes for the
+     line terminators only copy the pages they touch. */
+
+  mapped = st.st_size + 1;
+  text = mmap (NULL, mapped, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (text != MAP_FAILED && st.st_size > 0 &&
+      mmap (text, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      munmap (text, mapped);
+      text = MAP_FAILED;
+    }
+  close (fd);
+  sysfault (text == MAP_FAILED, NULL);
+
+  command_line = new_command_text (text, st.st_size);
+  if (!command_line)
+    {
+      munmap (text, mapped);
+      return NULL;
+    }
+  command_line->mapped = mapped;
   return command_line;
 }
 
@@ -48,261 +115,705 @@ buffer_t *new_command_line (void)
 
 void release_command_line (buffer_t *command_line)
 {
-  free (command_line->buffer);
+  if (command_line->text)
+    {
+      if (command_line->mapped)
+	munmap (command_line->text, command_line->mapped);
+    }
+  else
+    {
+      free (command_line->buffer);
+      free (command_line->ahead);
+    }
   free (command_line);
 }
 
+int command_line_pending (buffer_t *command_line)
+{
+  if (command_line->text)
+    return 1;			/* Never waits. */
+  return command_line->ahead_start < command_line->ahead_end;
+}
+
+int command_line_getc (buffer_t *command_line)
+{
+  unsigned char c;
+  ssize_t read_bytes;
+
+  if (command_line->ahead_start < command_line->ahead_end)
+    return (unsigned char) command_line->ahead[command_line->ahead_start++];
 
+  do
+    read_bytes = read (command_line->fd, &c, 1);
+  while (read_bytes < 0 && errno == EINTR);
+  return read_bytes == 1 ? c : -1;
+}
+
+void command_line_transfer (buffer_t *from, buffer_t *to)
+{
+  int count = from->ahead_end - from->ahead_start;
 
-/* Read a line from standard input and store it in command_line->buffer.
-   The buffer size is enlarged if needed in steps of size BUFFER_STEP.
-   Return the number of bytes read or -1 on error. */
+  memcpy (to->ahead, from->ahead + from->ahead_start, count);
+  to->ahead_start = 0;
+  to->ahead_end = count;
+  from->ahead_start = from->ahead_end = 0;
+}
 
+/* Next line of an in memory command_line, terminated in place. */
+
+static int read_text_line (buffer_t *command_line)
+{
+  char *start, *newline;
+  size_t count;
+
+  if (command_line->text_pos >= command_line->text_size)
+    return 0;
+
+  start = command_line->text + command_line->text_pos;
+  count = command_line->text_size - command_line->text_pos;
+  newline = memchr (start, '\n', count);
+  if (newline)
+    count = newline - start;
+
+  start[count] = '\0';
+  command_line->buffer = start;
+  command_line->length = count;
+  command_line->text_pos += count + 1;
+  return count + 1;
+}
+
+/* Read a line from command_line->fd and store it in command_line->buffer.
+   Bytes are taken from the read ahead area, which is refilled with
+   one read() of READ_AHEAD bytes whenever it runs empty. The line buffer
+   doubles its size when needed, so long lines cost linear time.
+   Return the line length counting the newline, 0 at end of input or
+   -1 on error. */
 
 int read_command_line (buffer_t *command_line)
 {
-  int read_bytes, count, temp;
-  int read_more = 1;
-  char *offset, *p;
-  int howmany;
-
-  count = 0;
-  offset = command_line->buffer;
-  howmany = command_line->size;
-  while (read_more)
+  int length, count, size;
+  char *start, *newline, *p;
+  ssize_t read_bytes;
+
+  if (command_line->text)
+    return read_text_line (command_line);
+
+  length = 0;
+  while (1)
     {
+      start = command_line->ahead + command_line->ahead_start;
+      count = command_line->ahead_end - command_line->ahead_start;
+      newline = memchr (start, '\n', count);
+      if (newline)
+	count = newline - start;
+
+      /* Enlarge buffer. */
 
-      /* Read howmany bytes. */
+      if (length + count + 1 > command_line->size)
+	{
+	  for (size = command_line->size; length + count + 1 > size; size *= 2);
+	  p = realloc (command_line->buffer, size*sizeof(char));
+	  sysfault (!p, -1);
+	  command_line->buffer = p;
+	  command_line->size = size;
+	}
 
-      read_bytes = read (1, offset, howmany);      
-      count += read_bytes;
+      memcpy (command_line->buffer + length, start, count);
+      length += count;
+      command_line->ahead_start += count;
 
-      /* This happens also if the previous read left
-	 a trailing newline. */
-      if (offset[0]=='\n')
+      if (newline)
 	{
-	  offset[0]='\0';
-	  command_line->length=0;
-	  return --count;
+	  command_line->ahead_start++;	/* Skip the newline. */
+	  break;
 	}
 
-      
-      read_more = 0;
-      if (read_bytes < howmany)
-	offset[read_bytes-1] = '\0'; /* We read less than howmany; done. */
-      else
-	if (offset[read_bytes-1] == '\n')
-	  offset[read_bytes-1] = '\0'; /* We read exactly howmany; done. */
-	else			       /* There is more to read. */
-	  {
-	    /* Enlarge buffer. */
-
-	    temp = command_line->size;
-	    p = realloc (command_line->buffer, (temp + BUFFER_STEP)*sizeof(char));
-	    sysfault (!p, -1);
-
-	    /* Offest is the end of the buffer. */
-	    offset = command_line->buffer + count;
-	    command_line->size += BUFFER_STEP;
-	    howmany = BUFFER_STEP;
-
-	    read_more = 1;
-	  }
-      
+      /* Read ahead more input. */
+
+      command_line->ahead_start = command_line->ahead_end = 0;
+      do
+	read_bytes = read (command_line->fd, command_line->ahead, READ_AHEAD);
+      while (read_bytes < 0 && errno == EINTR);
+      sysfault (read_bytes < 0, -1);
+
+      if (read_bytes == 0)
+	{
+	  /* End of input: the last line may lack its newline. */
+	  if (length == 0)
+	    return 0;
+	  break;
+	}
+      command_line->ahead_end = read_bytes;
     }
 
-  command_line->length = count;
-  return count;
+  command_line->buffer[length] = '\0';
+  command_line->length = length;
+  return length + 1;
 }
 
 
 /* Allocate memory for a new pipeline. */
 
-pipeline_t *new_pipeline (void)
+pipeline_t *new_pipeline (arena_t *arena)
 {
   pipeline_t *pipeline;
-  int i,j;
 
-  pipeline = malloc (1*sizeof(pipeline_t));
+  pipeline = arena_calloc (arena, 1, sizeof(pipeline_t));
   sysfault (!pipeline, NULL);
-  
+  pipeline->arena = arena;
+  pipeline->ground = FOREGROUND;
 
-  /* Allocate a pipeline structure. */
+  return pipeline;
 
-  pipeline->command = malloc ((MAX_COMMANDS+1)*sizeof(char**));
-  if (!pipeline->command)
-    {
-      sysdebug (1);
-      free (pipeline);
-      return NULL;
-    }
+}
+
+/* Lexical tokens. */
+
+enum
+  {
+    TOKEN_END,			/* End of the command line. */
+    TOKEN_WORD,			/* Command, argument or file name. */
+    TOKEN_PIPE,			/* | */
+    TOKEN_AMP,			/* & */
+    TOKEN_SEMI,			/* ; */
+    TOKEN_AND_IF,		/* && */
+    TOKEN_OR_IF,		/* || */
+    TOKEN_LESS,			/* < */
+    TOKEN_DLESS,		/* << */
+    TOKEN_TLESS,		/* <<< */
+    TOKEN_GREAT,		/* > */
+    TOKEN_DGREAT,		/* >> */
+    TOKEN_ERR_GREAT,		/* 2> */
+    TOKEN_ERR_DGREAT,		/* 2>> */
+    TOKEN_BAD_QUOTE,		/* Quote not closed before the end of line. */
+    TOKEN_LBRACE,		/* { starting a command, see parse_pipeline(). */
+    TOKEN_RBRACE		/* } starting a command. */
+  };
+
+#define isblk(c) ((c==' ') || (c=='\t') || (c=='\n')  ) 
+#define ismeta(c) ((c=='|') || (c=='&') || (c==';') || (c=='<') || (c=='>'))
+
+/* Scan the token starting at *pos in line and advance *pos past it.
+   Words are not copied: their offset and length in line are stored
+   in word, quotes included. */
+
+static int next_token (const char *line, int *pos, word_t *word)
+{
+  const char *s;
+  int i = *pos;
+
+  while (isblk (line[i]))
+    i++;
+  if (line[i] == '#')		/* Comment up to the end of line. */
+    i += strlen (line+i);
 
-  /* Allocate memory for commands. */
-  for (i=0; i<MAX_COMMANDS+1; i++)
+  word->offset = i;
+  word->length = 0;
+  *pos = i+1;
+
+  switch (line[i])
     {
-      pipeline->command[i] = malloc ((MAX_ARGUMENTS+1)*sizeof (char*));
-      if (!pipeline->command[i])
-      	{
-      	  sysdebug(1);
-      	  for (j=0; j<i; j++)
-      	      free (pipeline->command[j]);
-      	  free(pipeline->command);
-      	  free (pipeline);
-      	  return NULL;
-      	} 
+    case '\0':
+      *pos = i;
+      return TOKEN_END;
+    case '|':
+      if (line[i+1] != '|')
+	return TOKEN_PIPE;
+      *pos = i+2;
+      return TOKEN_OR_IF;
+    case '&':
+      if (line[i+1] != '&')
+	return TOKEN_AMP;
+      *pos = i+2;
+      return TOKEN_AND_IF;
+    case ';':
+      return TOKEN_SEMI;
+    case '<':
+      if (line[i+1] != '<')
+	return TOKEN_LESS;
+      if (line[i+2] != '<')
+	{
+	  *pos = i+2;
+	  return TOKEN_DLESS;
+	}
+      *pos = i+3;
+      return TOKEN_TLESS;
+    case '>':
+      if (line[i+1] != '>')
+	return TOKEN_GREAT;
+      *pos = i+2;
+      return TOKEN_DGREAT;
+    case '2':
+      if (line[i+1] != '>')
+	break;
+      if (line[i+2] != '>')
+	{
+	  *pos = i+2;
+	  return TOKEN_ERR_GREAT;
+	}
+      *pos = i+3;
+      return TOKEN_ERR_DGREAT;
     }
 
-  pipeline->ground = FOREGROUND;
-  pipeline->file_in[0]='\0';
-  pipeline->file_out[0]='\0';
+  /* A word runs up to the first unquoted blank or operator. */
 
-  return pipeline;
+  while (line[i] && !isblk (line[i]) && !ismeta (line[i]))
+    {
+      switch (line[i])
+	{
+	case '\\':
+	  i += line[i+1] ? 2 : 1;
+	  break;
+	case '\'':
+	  s = strchr (line+i+1, '\'');
+	  if (!s)
+	    return TOKEN_BAD_QUOTE;
+	  i = s - line + 1;
+	  break;
+	case '"':
+	  for (i++; line[i] && line[i] != '"'; i++)
+	    if (line[i] == '\\' && line[i+1])
+	      i++;
+	  if (!line[i])
+	    return TOKEN_BAD_QUOTE;
+	  i++;
+	  break;
+	default:
+	  i++;
+	}
+    }
 
+  word->length = i - word->offset;
+  *pos = i;
+  return TOKEN_WORD;
 }
 
-void release_pipeline (pipeline_t *pipeline)
+/* Copy word to dst without its quotes and escapes. Return the
+   resulting length, which is never more than word.length. */
+
+int unquote_word (const char *line, word_t word, char *dst)
 {
-  /* int i,j;			 */
-  int i;                     /* Iterate through commands. */
-  for (i=0; i<MAX_COMMANDS; i++)
+  const char *s = line + word.offset;
+  const char *end = s + word.length;
+  char *d = dst;
+
+  while (s < end)
     {
-      /* for (j=0; i<MAX_ARGUMENTS; j++) */
-      /* 	{ */
-      /* 	  free (pipeline->command[i][j]); */
-      /* 	} */
-      free (pipeline->command[i]);
+      switch (*s)
+	{
+	case '\\':
+	  if (++s < end)
+	    *d++ = *s++;
+	  break;
+	case '\'':
+	  for (s++; *s != '\''; s++)
+	    *d++ = *s;
+	  s++;
+	  break;
+	case '"':
+	  for (s++; *s != '"'; s++)
+	    {
+	      /* Inside double quotes backslash only escapes these. */
+	      if (*s == '\\' && strchr ("\"\\$`", s[1]))
+		s++;
+	      *d++ = *s;
+	    }
+	  s++;
+	  break;
+	default:
+	  *d++ = *s++;
+	}
     }
+
+  return d - dst;
 }
 
-#define isblk(c) ((c==' ') || (c=='\t') || (c=='\n')  ) 
+/* Words of the command being parsed, kept in a list until the
+   command ends and its size is known. */
 
+typedef struct word_node_t
+{
+  struct word_node_t *next;
+  word_t word;
+} word_node_t;
+
+typedef struct command_node_t
+{
+  struct command_node_t *next;
+  command_t command;
+} command_node_t;
 
 enum 
   {
-    PARSER_TOO_MANY_ARGUMENTS=1, 
-    PARSER_TOO_MANY_COMMANDS=2,
-    PARSER_STUFF_AFTER_AMP=4
+    PARSER_BAD_QUOTE=1,
+    PARSER_EMPTY_COMMAND=2,
+    PARSER_BAD_GROUP=4,
+    PARSER_MISSING_FILE=8,
+    PARSER_NO_MEMORY=16,
+    PARSER_BAD_HEREDOC=32
   } parser_error_t;
 
-int find_modifiers (buffer_t *command_line, pipeline_t *pipeline)
+/* Where the parser is in the command line. */
+
+typedef struct parser_t
 {
-  int amp;			/* '&' position */
-  int lt, gt;
-  int len, truncated;
-  int i,j, k;
+  arena_t *arena;		/* Where the pipelines are allocated. */
+  const char *line;		/* The command line. */
+  int pos;			/* Offset of the next token. */
+  int error;			/* Combination of parser_error_t flags. */
+} parser_t;
 
+/* Turn the word list into the argument vector of a new command node. */
 
+static command_node_t *end_command (arena_t *arena, word_node_t *words, int nwords)
+{
+  command_node_t *node;
+  int i;
+
+  node = arena_alloc (arena, sizeof (command_node_t));
+  sysfault (!node, NULL);
+  node->next = NULL;
+  node->command.nwords = nwords;
+  node->command.words = arena_alloc (arena, nwords * sizeof (word_t));
+  sysfault (!node->command.words, NULL);
+  for (i=0; i<nwords; i++, words = words->next)
+    node->command.words[i] = words->word;
+  return node;
+}
+
+/* Parse the pipeline starting at the parser position. Return the token
+   that ended it: TOKEN_END, TOKEN_AMP (the pipeline is then in
+   background), TOKEN_SEMI, TOKEN_AND_IF or TOKEN_OR_IF; or TOKEN_LBRACE
+   and TOKEN_RBRACE for an unquoted { or } where the pipeline would
+   start, which is then left empty. Errors are set in the parser. */
+
+static int parse_pipeline (parser_t *parser, pipeline_t *pipeline)
+{
+  arena_t *arena = parser->arena;
+  const char *line = parser->line;
+  word_node_t *words = NULL, **last_word = &words;
+  command_node_t *commands = NULL, **last_command = &commands;
+  redirect_t **last_redirect = &pipeline->redirect;
+  int nwords = 0;
+  int token;
+  word_t word;
+
+  pipeline->line = line;
   pipeline->ground = FOREGROUND;
-  pipeline->file_in[0] = '\0';
-  pipeline->file_out[0] = '\0';
+  pipeline->redirect = NULL;
+  pipeline->ncommands = 0;
+  pipeline->text.length = 0;
 
-  truncated = 0;
-  len = command_line->length;
+  while (1)
+    {
+      token = next_token (line, &parser->pos, &word);
 
-  /* Find &, if any. */
-  amp = strcspn (command_line->buffer, "&");
+      if (pipeline->text.length == 0)
+	pipeline->text.offset = word.offset;
 
-  if (amp != (len-1))
-    pipeline->ground = BACKGROUND;
+      switch (token)
+	{
+	case TOKEN_WORD:
+	  if (nwords == 0 && pipeline->ncommands == 0 && !pipeline->redirect
+	      && word.length == 1 && strchr ("{}", line[word.offset]))
+	    return line[word.offset] == '{' ? TOKEN_LBRACE : TOKEN_RBRACE;
+	  *last_word = arena_alloc (arena, sizeof (word_node_t));
+	  if (!*last_word)
+	    {
+	      parser->error |= PARSER_NO_MEMORY;
+	      return TOKEN_END;
+	    }
+	  (*last_word)->word = word;
+	  last_word = &(*last_word)->next;
+	  nwords++;
+	  pipeline->text.length = parser->pos - pipeline->text.offset;
+	  continue;
+
+	case TOKEN_LESS:
+	case TOKEN_DLESS:
+	case TOKEN_TLESS:
+	case TOKEN_GREAT:
+	case TOKEN_DGREAT:
+	case TOKEN_ERR_GREAT:
+	case TOKEN_ERR_DGREAT:
+	  *last_redirect = arena_alloc (arena, sizeof (redirect_t));
+	  if (!*last_redirect)
+	    {
+	      parser->error |= PARSER_NO_MEMORY;
+	      return TOKEN_END;
+	    }
+	  (*last_redirect)->next = NULL;
+	  (*last_redirect)->here = NULL;
+	  (*last_redirect)->here_length = 0;
+	  (*last_redirect)->here_expand = 0;
+	  (*last_redirect)->fd =
+	    (token == TOKEN_LESS || token == TOKEN_DLESS || token == TOKEN_TLESS) ? 0 :
+	    (token == TOKEN_GREAT || token == TOKEN_DGREAT) ? 1 : 2;
+	  (*last_redirect)->mode = token == TOKEN_LESS ? REDIRECT_READ :
+	    token == TOKEN_DLESS ? REDIRECT_HEREDOC :
+	    token == TOKEN_TLESS ? REDIRECT_HERESTRING :
+	    (token == TOKEN_DGREAT || token == TOKEN_ERR_DGREAT) ?
+	    REDIRECT_APPEND : REDIRECT_WRITE;
+	  if (next_token (line, &parser->pos, &(*last_redirect)->file) != TOKEN_WORD)
+	    parser->error |= PARSER_MISSING_FILE;
+	  last_redirect = &(*last_redirect)->next;
+	  pipeline->text.length = parser->pos - pipeline->text.offset;
+	  continue;
+
+	case TOKEN_AMP:
+	  pipeline->ground = BACKGROUND;
+	  pipeline->text.length = parser->pos - pipeline->text.offset;
+	  break;
+
+	case TOKEN_BAD_QUOTE:
+	  parser->error |= PARSER_BAD_QUOTE;
+	  token = TOKEN_END;
+	  break;
+	}
 
+      /* End of a command: '|' or the end of the pipeline. */
 
-  for (i=amp+1; i<len-1; i++)
-    if (!isblk (command_line->buffer[i]))
-      truncated |= PARSER_STUFF_AFTER_AMP;
-  command_line->buffer[amp]='\0';
-  command_line->length=amp;
-  len=amp;
+      if (nwords == 0)
+	{
+	  if (token == TOKEN_PIPE || pipeline->ncommands > 0 ||
+	      pipeline->ground == BACKGROUND || pipeline->redirect)
+	    parser->error |= PARSER_EMPTY_COMMAND;
+	}
+      else
+	{
+	  *last_command = end_command (arena, words, nwords);
+	  if (!*last_command)
+	    {
+	      parser->error |= PARSER_NO_MEMORY;
+	      return TOKEN_END;
+	    }
+	  last_command = &(*last_command)->next;
+	  pipeline->ncommands++;
+
+	  words = NULL;
+	  last_word = &words;
+	  nwords = 0;
+	}
 
-  /* Find output redirect. */
-  
-  lt = strcspn (command_line->buffer, "<");
-  if (lt!=len)
-    {
-      for (i=lt+1; isblk(command_line->buffer[i]); i++);
-      /* printf ("lt found (%s)\n", command_line->buffer+i); */
-      j=0;
-      while ((i<len) && (i<MAX_FILENAME) && 
-	     (!isblk(command_line->buffer[i])) && (command_line->buffer[i]!='<'))
-	pipeline->file_in[j++]=command_line->buffer[i++];
-      pipeline->file_in[j]='\0';
+      if (token != TOKEN_PIPE || parser->error)
+	break;
     }
-  /* printf ("lt now (%s)\n", pipeline->file_in); */
 
-  gt = strcspn (command_line->buffer, ">");
-  if (gt!=len)
+  /* Lay the commands out in an array. */
+
+  if (!parser->error && pipeline->ncommands > 0)
     {
-      for (i=gt+1; isblk(command_line->buffer[i]); i++);
-      /* printf ("gt found (%s)\n", command_line->buffer+i); */
-      j=0;
-      while ((i<len)  && (i<MAX_FILENAME) &&
-	     (!isblk(command_line->buffer[i])) && (command_line->buffer[i]!='<'))
-	pipeline->file_out[j++]=command_line->buffer[i++];
-      pipeline->file_out[j]='\0';
+      int i;
+      pipeline->command = arena_alloc (arena, pipeline->ncommands * sizeof (command_t));
+      if (!pipeline->command)
+	{
+	  parser->error |= PARSER_NO_MEMORY;
+	  return TOKEN_END;
+	}
+      for (i=0; commands; commands = commands->next)
+	pipeline->command[i++] = commands->command;
     }
-  /* printf ("gt now (%s)\n", pipeline->file_out); */
-
-  k = lt < gt ? lt : gt;
-  k = k < len ? k : k+1;
-  command_line->buffer[k-1]='\0';
-  command_line->length=k;
-
-  
-  debug (truncated && PARSER_STUFF_AFTER_AMP, "Nothing allowed after '&'");
-  
-  return truncated;
 
+  return token;
 }
 
+/* Parse the list starting at the parser position into first and the
+   pipelines linked to it, up to the end of line (depth 0) or to the }
+   closing a group (depth > 0). Return the token that ended the list. */
 
-/* Parse command_line into pipeline. Return 0 on success, 1 if too many arguments,
-   2 if too many commands in a pipeline; 1+2 if both errors occur.*/
-
-int parse_command_line (buffer_t *command_line, pipeline_t *pipeline)
+static int parse_list (parser_t *parser, pipeline_t *first, int depth)
 {
-  int i, j, truncated;
-  char * token, *token2, *bkstring;
+  pipeline_t *node = first, *prev = NULL;
+  int connector = LIST_SEQ;
+  int token;
+  word_t word;
 
+  while (1)
+    {
+      node->connector = connector;
+      node->group = NULL;
+      node->next = NULL;
+      token = parse_pipeline (parser, node);
 
-  truncated = 0;
+      if (token == TOKEN_LBRACE && !parser->error)
+	{
+	  node->group = new_pipeline (parser->arena);
+	  if (!node->group)
+	    {
+	      parser->error |= PARSER_NO_MEMORY;
+	      return TOKEN_END;
+	    }
+	  if (parse_list (parser, node->group, depth+1) != TOKEN_RBRACE ||
+	      (node->group->ncommands == 0 && !node->group->group))
+	    parser->error |= PARSER_BAD_GROUP;
+
+	  /* Groups are not pipeline stages: only a list operator,
+	     another } or the end of line may follow. */
+	  token = next_token (parser->line, &parser->pos, &word);
+	  if (token == TOKEN_WORD && word.length == 1 && parser->line[word.offset] == '}')
+	    token = TOKEN_RBRACE;
+	  else if (token != TOKEN_SEMI && token != TOKEN_AND_IF &&
+		   token != TOKEN_OR_IF && token != TOKEN_END)
+	    parser->error |= PARSER_BAD_GROUP;
+	}
+      if (parser->error)
+	return TOKEN_END;
 
-  truncated |= find_modifiers (command_line, pipeline);
+      /* Only the end of a list may be empty, as in "a;" or "{ a; }". */
 
-  i = 0;
-    while((i<MAX_COMMANDS) &&
-	(token = strtok_r (i==0 ? command_line->buffer : NULL, "|", &bkstring)))
-    {
-      while ((token[0] == ' ') || (token[0] == '\t'))
-	token++;
-      
-      j=0;
-      while ((j<MAX_ARGUMENTS) &&
-	     (token2 = strtok (j == 0 ? token : NULL, " \t")))
+      if (node->ncommands == 0 && !node->group)
 	{
-	  pipeline->command[i][j] = token2;
-	  j++;
+	  if ((token != TOKEN_END && token != TOKEN_RBRACE) || connector != LIST_SEQ)
+	    {
+	      parser->error |= PARSER_EMPTY_COMMAND;
+	      return TOKEN_END;
+	    }
+	  if (prev)
+	    prev->next = NULL;
 	}
 
-      pipeline->command[i][j] = NULL;
-      i++;
-      truncated |= strtok (NULL, " \t") ? PARSER_TOO_MANY_ARGUMENTS : 0;
+      switch (token)
+	{
+	case TOKEN_END:
+	  if (depth > 0)
+	    parser->error |= PARSER_BAD_GROUP;
+	  return token;
+	case TOKEN_RBRACE:
+	  if (depth == 0)
+	    parser->error |= PARSER_BAD_GROUP;
+	  return token;
+	case TOKEN_AND_IF:
+	  connector = LIST_AND;
+	  break;
+	case TOKEN_OR_IF:
+	  connector = LIST_OR;
+	  break;
+	default:		/* ';' or '&' */
+	  connector = LIST_SEQ;
+	}
 
-      pipeline->narguments[i-1] = j;
-      
+      prev = node;
+      node->next = new_pipeline (parser->arena);
+      if (!node->next)
+	{
+	  parser->error |= PARSER_NO_MEMORY;
+	  return TOKEN_END;
+	}
+      node = node->next;
     }
-    pipeline->command[i][0]=NULL;
-    truncated |= strtok_r (NULL, " \t", &bkstring) ? PARSER_TOO_MANY_COMMANDS : 0;
-    
-    pipeline->ncommands = i;
-    
+}
 
-    debug (truncated & PARSER_TOO_MANY_ARGUMENTS, "Too many arguments in a command");
-    debug (truncated & PARSER_TOO_MANY_COMMANDS, "Too many commands in a pipeline");
+/* Read the text of the here-documents of the list starting at
+   pipeline, in command line order, from the lines that follow. */
 
-  return truncated;
+static void read_here_documents (parser_t *parser, buffer_t *command_line,
+				 pipeline_t *pipeline)
+{
+  redirect_t *r;
+  char *text = NULL, *delimiter;
+  int size = 0, length;
+
+  for (; pipeline && !parser->error; pipeline = pipeline->next)
+    {
+      read_here_documents (parser, command_line, pipeline->group);
+
+      for (r = pipeline->redirect; r && !parser->error; r = r->next)
+	{
+	  if (r->mode != REDIRECT_HEREDOC)
+	    continue;
+
+	  /* A quoted delimiter keeps the text as is. */
+	  delimiter = arena_alloc (parser->arena, r->file.length + 1);
+	  if (!delimiter)
+	    {
+	      parser->error |= PARSER_NO_MEMORY;
+	      break;
+	    }
+	  delimiter[unquote_word (parser->line, r->file, delimiter)] = '\0';
+	  r->here_expand = !memchr (parser->line + r->file.offset, '\'', r->file.length)
+	    && !memchr (parser->line + r->file.offset, '"', r->file.length)
+	    && !memchr (parser->line + r->file.offset, '\\', r->file.length);
+
+	  length = 0;
+	  while (1)
+	    {
+	      if (!command_line->text && isatty (command_line->fd))
+		{
+		  printf ("> ");
+		  fflush (stdout);
+		}
+	      if (read_command_line (command_line) <= 0)
+		{
+		  parser->error |= PARSER_BAD_HEREDOC;
+		  break;
+		}
+	      if (!strcmp (command_line->buffer, delimiter))
+		break;
+
+	      /* Keep the line and its newline. */
+	      if (length + command_line->length + 1 > size)
+		{
+		  size = 2 * (length + command_line->length + 1);
+		  text = realloc (text, size);
+		  if (!text)
+		    {
+		      parser->error |= PARSER_NO_MEMORY;
+		      return;
+		    }
+		}
+	      memcpy (text + length, command_line->buffer, command_line->length);
+	      length += command_line->length;
+	      text[length++] = '\n';
+	    }
+
+	  r->here = arena_strndup (parser->arena, text ? text : "", length);
+	  r->here_length = length;
+	  if (!r->here)
+	    parser->error |= PARSER_NO_MEMORY;
+	}
+    }
+
+  free (text);
 }
 
+/* Parse command_line into the list starting at pipeline in a single pass
+   over the line. Return 0 on success or a combination of parser_error_t
+   flags. */
 
+int parse_command_line (buffer_t *command_line, pipeline_t *pipeline)
+{
+  parser_t parser;
+
+  parser.arena = pipeline->arena;
+  parser.line = command_line->buffer;
+  parser.pos = 0;
+  parser.error = 0;
+
+  /* Reading here-documents overwrites the line, the words refer to a copy. */
+  if (strstr (command_line->buffer, "<<"))
+    {
+      parser.line = arena_strndup (parser.arena, command_line->buffer,
+				   command_line->length);
+      sysfault (!parser.line, PARSER_NO_MEMORY);
+    }
 
+  parse_list (&parser, pipeline, 0);
 
+  if (!parser.error)
+    read_here_documents (&parser, command_line, pipeline);
 
+  if (parser.error)
+    {
+      pipeline->ncommands = 0;
+      pipeline->group = NULL;
+      pipeline->next = NULL;
+      fprintf (stderr, "syntax error: %s\n",
+	       parser.error & PARSER_BAD_QUOTE ? "unterminated quote" :
+	       parser.error & PARSER_MISSING_FILE ? "missing file name after redirection" :
+	       parser.error & PARSER_BAD_GROUP ? "unbalanced or misplaced { }" :
+	       parser.error & PARSER_BAD_HEREDOC ? "here-document not terminated" :
+	       "empty command");
+    }
 
+  return parser.error;
+}
@@ -0,0 +1,83 @@
+/* priority.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "priority.h"
+#include "vars.h"
+
+/* From linux/ioprio.h, which glibc does not wrap */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+/* Nice value and I/O priority of the shell */
+static int shell_nice;
+static int shell_ioprio;
+
+static void set_ioprio(int which, pid_t who, int ioprio) {
+#ifdef SYS_ioprio_set
+    syscall(SYS_ioprio_set, which, who, ioprio);
+#endif
+}
+
+void priority_init() {
+    errno = 0;
+    shell_nice = getpriority(PRIO_PROCESS, 0);
+    if (errno != 0) {
+        shell_nice = 0;
+    }
+#ifdef SYS_ioprio_get
+    shell_ioprio = (int) syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+    if (shell_ioprio < 0) {
+        shell_ioprio = 0; /* none: follows the nice value */
+    }
+#endif
+}
+
+bool priority_background(int* nice) {
+    const char* value = var_get(PRIORITY_VAR);
+    char* end;
+
+    if (!value || !*value) {
+        return false;
+    }
+    *nice = (int) strtol(value, &end, 10);
+    return *end == '\0';
+}
+
+void priority_set(pid_t pid, bool background, int nice) {
+    struct sched_param param = {0};
+
+    setpriority(PRIO_PROCESS, (id_t) pid, background ? nice : shell_nice);
+    sched_setscheduler(pid, background ? SCHED_BATCH : SCHED_OTHER, &param);
+    set_ioprio(IOPRIO_WHO_PROCESS, pid, background ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT : shell_ioprio);
+}
+
+void priority_set_group(pid_t pgid, bool background, int nice) {
+    setpriority(PRIO_PGRP, (id_t) pgid, background ? nice : shell_nice);
+    set_ioprio(IOPRIO_WHO_PGRP, pgid, background ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT : shell_ioprio);
+}
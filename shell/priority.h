@@ -0,0 +1,46 @@
+/* priority.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_PRIORITY_H
+#define IMP_PRIORITY_H
+
+#include <stdbool.h>
+#include <unistd.h>
+
+/* Shell variable that turns the background policy on: the nice value of
+ * background jobs, which also run SCHED_BATCH with the idle I/O priority */
+#define PRIORITY_VAR "ROYALDUTCH_NICE"
+
+/* Remember the nice value and I/O priority of the shell, the ones
+ * foreground jobs get back */
+void priority_init();
+
+/* True if background jobs are demoted, *nice is then their nice value */
+bool priority_background(int* nice);
+
+/* Demote (background) or restore pid, 0 for the calling process: nice
+ * value, scheduling policy and I/O priority. Best effort: raising the
+ * priority back may need privileges the shell does not have. */
+void priority_set(pid_t pid, bool background, int nice);
+
+/* Same for the nice value and I/O priority of a whole process group (the
+ * scheduling policy can only be set process by process) */
+void priority_set_group(pid_t pgid, bool background, int nice);
+
+#endif
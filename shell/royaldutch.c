@@ -17,6 +17,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "royaldutch.h"
+#include "cmdhash.h"
+#include "event.h"
+#include "trace.h"
+#include "jobserver.h"
+#include "vars.h"
+#include "zygote.h"
+#include "cgroup.h"
+#include "affinity.h"
+#include "priority.h"
+#include "metrics.h"
 
 #include <errno.h>
 #include <string.h>
@@ -24,21 +34,71 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/wait.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
 
-job* jobs_head;
+arena_t* line_arena;
 bool on_terminal;
 int shell_in = STDIN_FILENO;
 int shell_pgid;
 struct termios io_flags;
+int last_status;
+pid_t shell_pid;
+pid_t last_background;
+buffer_t* shell_input;
+bool exit_requested;
+
+/* True while waiting for the user to type a command line */
+static bool at_prompt;
+
+/* A job changed while the shell is idle at the prompt: tell the user right away */
+static void jobs_changed() {
+    if (at_prompt) {
+        printf("\n");
+        notify_background_jobs();
+        show_prompt();
+    }
+}
 
-void shell_init() {
-    jobs_head = calloc(1, sizeof(*jobs_head));
+/* SIGCHLD handler (run from the event loop): collect the stopped
+ * children, exits come through process_event() */
+static void child_event(int signo) {
+    if (reap_children()) {
+        jobs_changed();
+    }
+}
 
-    on_terminal = (bool) isatty(shell_in);
+void process_event(int fd, void* data) {
+    if (reap_process(data)) {
+        jobs_changed();
+    }
+}
+
+void shell_init(bool interactive) {
+    int fd;
+
+    /* a closed standard descriptor would be reused by the event self-pipe
+     * or a redirection and then clobbered by dup2() */
+    while ((fd = open("/dev/null", O_RDWR)) >= 0 && fd <= STDERR_FILENO);
+    if (fd > STDERR_FILENO) {
+        close(fd);
+    }
+
+    shell_pid = getpid();
+    vars_init();
+    trace_init();
+    line_arena = new_arena();
+
+    event_init();
+    event_signal(SIGCHLD, child_event);
+    jobserver_init();
+    cgroup_init();
+    affinity_init();
+    priority_init();
+
+    on_terminal = interactive && isatty(shell_in);
     if (on_terminal) { /* input on user terminal? */
 
         set_signals(SIG_IGN, false); /* set shell to ignore most signals */
-        signal(SIGTSTP, sigtstp_handler);
 
         shell_pgid = getpid();
         assert(setpgid(shell_pgid, shell_pgid) >= 0); /* make us a process group leader */
@@ -46,15 +106,36 @@ void shell_init() {
         tcsetpgrp(shell_in, shell_pgid); /* put stdin on foreground */
         tcgetattr(shell_in, &io_flags); /* save terminal mode */
     }
+
+    /* late, so that it starts with the shell setup and as little memory */
+    if (var_get(ZYGOTE_ENV) && *var_get(ZYGOTE_ENV)) {
+        zygote_start();
+    }
+
+    /* after the zygote, which must not hold the socket */
+    metrics_init();
 }
 
 
 void shell_release() {
-    job* j, * next;
-    for (j = jobs_head; j; j = next) {
-        next = j->next;
-        release_job(j);
+    zygote_stop();
+    metrics_release();
+    release_jobs(); /* gives back the tokens still held */
+    jobserver_release();
+    cgroup_release();
+    cmdhash_release();
+    release_arena(line_arena);
+    event_release();
+    trace_release();
+    vars_release();
+}
+
+buffer_t* builtin_shell_input(process* proc) {
+    if (shell_input && !shell_input->text && shell_input->fd == STDIN_FILENO
+        && getpid() == shell_pid && proc->job->in == STDIN_FILENO) {
+        return shell_input;
     }
+    return NULL;
 }
 
 void print_error(char* message) {
@@ -74,68 +155,179 @@ char* last_dir(char* path) {
     return (last ? last : "/");
 }
 
-int prompt(buffer_t* buffer, struct job** job) {
+void show_prompt() {
+    char cwd[PATH_MAX];
+    printf("%s [%s] ", PROMPT, last_dir(getcwd(cwd, sizeof(cwd))));
+    fflush(stdout);
+}
+
+int prompt(buffer_t* buffer, pipeline_t** list) {
     int read;
-    pipeline_t* pipeline = new_pipeline();
+    pipeline_t* pipeline;
+    uint64_t start = TRACE_BEGIN(), span, measure;
 
-    /* show prompt */
-    char* cwd = getcwd(0, 0);
-    char* dir = last_dir(cwd);
-    printf("%s [%s] ", PROMPT, dir);
-    fflush(stdout);
-    free(cwd);
+    /* everything from the previous command line is released here */
+    arena_reset(line_arena);
+    pipeline = new_pipeline(line_arena);
 
-    read = read_command_line(buffer);
+    if (on_terminal) {
+        show_prompt();
+    }
 
-    /* parse and build job */
-    *job = NULL;
-    if (read > 0 && !parse_command_line(buffer, pipeline)) {
-        *job = job_from_pipeline(pipeline, buffer->buffer);
+    /* serve events (children exiting) until there is input */
+    if (!command_line_pending(buffer)) {
+        span = TRACE_BEGIN();
+        at_prompt = true;
+        while (event_wait(buffer->fd, -1) == 0);
+        at_prompt = false;
+        TRACE_END("wait_input", span, NULL, -1);
     }
 
-    release_pipeline(pipeline);
+    read = read_command_line(buffer);
 
+    /* parse the whole line at once */
+    *list = NULL;
+    if (read > 0) {
+        span = TRACE_BEGIN();
+        measure = METRICS_BEGIN();
+        if (parse_command_line(buffer, pipeline)) {
+            last_status = 2; /* syntax error */
+        } else if (pipeline->ncommands > 0 || pipeline->group) {
+            *list = pipeline;
+        }
+        METRICS_END(METRIC_PARSE, measure);
+        TRACE_END("parse_command_line", span, NULL, read);
+    }
+
+    TRACE_END("prompt", start, NULL, -1);
     return read;
 }
 
+void run_pipeline(pipeline_t* pipeline) {
+    job* job;
+    uint64_t span = TRACE_BEGIN();
+
+    job = job_from_pipeline(pipeline);
+    TRACE_END("job_from_pipeline", span, NULL, pipeline->ncommands);
+    if (!job) {
+        last_status = 1; /* redirection failed, already reported */
+        return;
+    }
+
+    /* Launch the job (builtins run right away) and put it on the job table */
+    launch_job(job);
+    put_job(job);
+
+    /* Launching jobs resets signal handlers, restore them here */
+    if (on_terminal) {
+        set_signals(SIG_IGN, false);
+    }
+
+    if (job->background) {
+        last_status = 0;
+        if (job->procs[job->number_procs - 1].pid > 0) {
+            last_background = job->procs[job->number_procs - 1].pid;
+        }
+        if (job_completed(job)) {
+            remove_job(job); /* no process could be executed, errors were already reported */
+        } else if (on_terminal) {
+            printf("[%d] started\n", job->pgid);
+        }
+    } else {
+        wait_foreground_job(job);
+    }
+}
+
+void run_list(pipeline_t* list) {
+    pipeline_t* p;
+
+    for (p = list; p && !exit_requested; p = p->next) {
+        /* a && b runs b if a succeeded, a || b if it failed */
+        if ((p->connector == LIST_AND && last_status != 0)
+            || (p->connector == LIST_OR && last_status == 0)) {
+            continue;
+        }
+        if (p->group) {
+            run_list(p->group);
+        } else {
+            run_pipeline(p);
+        }
+    }
+}
+
 void wait_foreground_job(struct job* job) {
-    int status, pid;
+    uint64_t start = TRACE_BEGIN(), measure;
 
-    tcsetpgrp(shell_in, job->pgid); /* bring group foreground */
+    /* nothing to wait for if no process could be started */
+    if (!job_stopped(job)) {
+        measure = METRICS_BEGIN();
+        if (on_terminal) {
+            tcsetpgrp(shell_in, job->pgid); /* bring group foreground */
+        }
 
-    do {
-        pid = waitpid(-1, &status, WUNTRACED);
-    } while (jobs_update_status(pid, status) && !job_stopped(job)); /* Wait until job is stopped */
+        /* the pidfds of its processes and SIGCHLD (stops) wake the loop */
+        while (!job_stopped(job) && event_wait(-1, -1) >= 0);
+        METRICS_END(METRIC_WAIT, measure);
+    }
 
     /* If the job is done, remove it from the list */
     if (job_completed(job)) {
+        last_status = job_exit_status(job);
+        if (job->timed) {
+            print_job_usage(job, stderr);
+        }
         remove_job(job);
+    } else {
+        last_status = 128 + SIGTSTP;
     }
 
     /* bring shell to foreground */
-    tcsetpgrp(shell_in, shell_pgid);
-    tcsetattr(shell_in, TCSADRAIN, &io_flags);
+    if (on_terminal) {
+        tcsetpgrp(shell_in, shell_pgid);
+        tcsetattr(shell_in, TCSADRAIN, &io_flags);
+    }
+    TRACE_END("wait_foreground_job", start, NULL, -1);
 }
 
 void notify_background_jobs() {
     job* j, * next;
-    int pid, status;
+    size_t kept = 0;
 
-    do {
-        pid = waitpid(-1, &status, WUNTRACED | WNOHANG);
-    } while (jobs_update_status(pid, status)); /* Update all pending job signals */
+    if (!at_prompt) {
+        event_wait(-1, 0); /* collect what is pending, without waiting */
+    }
 
-    for (j = jobs_head->next; j; j = next) {
+    for (j = jobs_table.first; j; j = next) {
         next = j->next;
 
         /* Notify user of job completed or stopped */
         if (job_completed(j)) {
-            printf("[%d] completed\n", j->pgid);
-            remove_job(j); /* Completed jobs are removed from the list */
+            if (!j->reported) {
+                if (on_terminal) {
+                    printf("[%d] completed\n", j->pgid);
+                }
+                if (j->timed) {
+                    fflush(stdout);
+                    print_job_usage(j, stderr);
+                }
+                j->reported = true;
+            }
+            kept++; /* with its status, until wait asks for it */
 
         } else if (job_stopped(j) && !j->notified) {
             j->notified = true;
-            printf("\n[%d] suspended\n", j->pgid);
+            if (on_terminal) {
+                printf("\n[%d] suspended\n", j->pgid);
+            }
+        }
+    }
+
+    /* but a shell that never waits does not keep them all */
+    for (j = jobs_table.first; j && kept > WAIT_REMEMBERED; j = next) {
+        next = j->next;
+        if (job_completed(j)) {
+            remove_job(j);
+            kept--;
         }
     }
 }
@@ -146,15 +338,19 @@ void set_signals(__sighandler_t handler, bool override_sigtstp) {
     signal(SIGTTIN, handler);
     signal(SIGTTOU, handler);
     /* if not overriding SIGTSTP, reset it to shell default handler */
-    signal(SIGTSTP, override_sigtstp ? handler : sigtstp_handler);
+    if (override_sigtstp) {
+        signal(SIGTSTP, handler);
+    } else {
+        event_signal(SIGTSTP, sigtstp_handler);
+    }
     /*signal(SIGCHLD, handler);*/
 }
 
 void sigtstp_handler(int signo) {
     job* j = find_latest_job(SEARCH_RUNNING);
     if (j) {
-        if (killpg(j->pgid, SIGTSTP) < 0) { /* Send suspend to latest running child */
-            print_error("killpg");
+        if (!job_signal(j, SIGTSTP)) { /* Send suspend to latest running child */
+            print_error("kill");
         }
     }
 }
@@ -162,18 +358,21 @@ void sigtstp_handler(int signo) {
 /**************************************************
  * Built-in functions
  **************************************************/
-void builtin_cd(struct job* job) {
-    process* proc = &job->procs[0];
+int builtin_cd(process* proc) {
     if (proc->argc > 1) {
         int ret = chdir(proc->argv[1]);
         if (ret == -1) {
             print_error("chdir");
+            return 1;
         }
     }
+    return 0;
 }
 
-void builtin_jobs(struct job* job) {
+int builtin_jobs(process* proc) {
+    bool verbose = proc->argc > 1 && strcmp(proc->argv[1], "-v") == 0;
     struct job* j;
+    size_t i;
     int pid, status;
 
     /* TODO: This was supposed to update job status, but using kill <pgid> doesn't get us a signal here :( */
@@ -182,11 +381,58 @@ void builtin_jobs(struct job* job) {
         *//*printf("pid: %d, status: %d", pid, status);*//*
     } while (jobs_update_status(pid, status));*/
 
-    for (j = jobs_head->next; j; j = j->next) {
-        if (j->background || job_stopped(j)) {
-            printf("[%d]\t%s\t(%s)\n", j->pgid, j->command_line, job_str_status(j));
+    for (j = jobs_table.first; j; j = j->next) {
+        if ((j->background || job_stopped(j)) && !j->reported) {
+            printf("[%d]\t%s\t(%s)", j->pgid, j->command_line, job_str_status(j));
+            /* the CPUs of the job, or of each process if spread */
+            for (i = 0; i < j->number_procs && j->procs[i].cpus; i++) {
+                if (i == 0 || j->spread) {
+                    printf("%s%s", i == 0 ? "\tcpus " : "|", j->procs[i].cpus);
+                }
+            }
+            printf("\n");
+            if (verbose) {
+                print_job_usage(j, stdout);
+            }
         }
     }
+    return 0;
+}
+
+/* Print one command cache entry */
+static void print_hash_entry(hashtab_entry* entry, void* data) {
+    cmdhash_entry* cached = entry->value;
+    if (cached->path) {
+        printf("%4lu\t%s\n", cached->hits, cached->path);
+    }
+}
+
+int builtin_hash(process* proc) {
+    size_t i;
+    int ret = 0;
+
+    if (proc->argc > 1 && strcmp(proc->argv[1], "-r") == 0) {
+        cmdhash_reset();
+        return 0;
+    }
+
+    /* hash <name>...: look the names up now */
+    for (i = 1; i < proc->argc; i++) {
+        if (!cmdhash_lookup(proc->argv[i])) {
+            print_error(proc->argv[i]);
+            ret = 1;
+        }
+    }
+
+    if (proc->argc <= 1) {
+        if (!cmdhash_table || cmdhash_table->size == 0) {
+            printf("hash: hash table empty\n");
+            return 0;
+        }
+        printf("hits\tcommand\n");
+        hashtab_foreach(cmdhash_table, print_hash_entry, NULL);
+    }
+    return ret;
 }
 
 /* Find latest job stopped job or by pgid*/
@@ -201,33 +447,260 @@ static job* find_stopped(size_t argc, char** argv) {
 }
 
 
-void builtin_fg(struct job* job) {
-    process* proc = &job->procs[0];
+int builtin_fg(process* proc) {
     struct job* target = find_stopped(proc->argc, proc->argv);
 
-    /* Continue job */
+    /* Continue job, at the priority of the shell */
+    if (target) {
+        job_set_priority(target, false);
+    }
     if (!target || !continue_job(target)) {
         print_error("SIGCONT");
-    } else {
-        /* set as foreground and wait */
-        target->background = false;
-        wait_foreground_job(target);
+        return 1;
     }
+
+    /* set as foreground and wait */
+    target->background = false;
+    wait_foreground_job(target);
+    return last_status;
 }
 
 
-void builtin_bg(struct job* job) {
-    process* proc = &job->procs[0];
+int builtin_bg(process* proc) {
     struct job* target = find_stopped(proc->argc, proc->argv);
 
-    /* Continue job */
+    /* Continue job, demoted if background jobs are */
+    if (target) {
+        job_set_priority(target, true);
+    }
     if (!target || !continue_job(target)) {
         print_error("SIGCONT");
-    } else {
-        /* set as background and notify resume */
-        target->background = true;
-        printf("[%d] continued\n", target->pgid);
+        return 1;
+    }
+
+    /* set as background and notify resume */
+    target->background = true;
+    printf("[%d] continued\n", target->pgid);
+    return 0;
+}
+
+int builtin_parallel(process* proc) {
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* path = NULL;
+    buffer_t* input;
+    arena_t* arena;
+    job** slots;
+    size_t i, running = 0, started = 0, failed = 0;
+    bool more = true;
+    struct timespec begin, end;
+    double seconds;
+
+    /* parallel [-j N] [file] */
+    for (i = 1; i < proc->argc; i++) {
+        const char* arg = proc->argv[i];
+        if (strncmp(arg, "-j", 2) == 0) {
+            arg = arg[2] ? arg + 2 : i + 1 < proc->argc ? proc->argv[++i] : "";
+            max = atol(arg);
+            if (max <= 0) {
+                fprintf(stderr, "parallel: -j: positive number expected\n");
+                return 2;
+            }
+        } else if (!path) {
+            path = arg;
+        } else {
+            fprintf(stderr, "usage: parallel [-j N] [file]\n");
+            return 2;
+        }
+    }
+    if (max <= 0) {
+        max = 1;
+    }
+
+    input = path ? new_command_file(path) : new_command_line();
+    if (!input) {
+        print_error((char*) path);
+        return 1;
+    }
+    if (!path && builtin_shell_input(proc)) {
+        /* the lines the shell read ahead are the first ones */
+        command_line_transfer(shell_input, input);
+    }
+    arena = new_arena();
+    slots = calloc((size_t) max, sizeof(*slots));
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    while (more || running > 0) {
+        /* fill the free slots */
+        while (more && running < (size_t) max) {
+            pipeline_t* pipeline;
+            job* job;
+
+            if (read_command_line(input) <= 0) {
+                more = false;
+                break;
+            }
+            arena_reset(arena);
+            pipeline = new_pipeline(arena);
+            if (parse_command_line(input, pipeline)) {
+                failed++;
+                continue;
+            }
+            if (pipeline->ncommands == 0 && !pipeline->group) {
+                continue; /* empty line or comment */
+            }
+            started++;
+            if (pipeline->group || pipeline->next) {
+                fprintf(stderr, "parallel: %s: one pipeline per line\n", input->buffer);
+                failed++;
+                continue;
+            }
+
+            /* never takes the terminal nor gets the foreground deadline */
+            pipeline->ground = BACKGROUND;
+            job = job_from_pipeline(pipeline);
+            if (!job) {
+                failed++;
+                continue;
+            }
+            launch_job(job);
+            put_job(job);
+
+            if (job_completed(job)) {
+                failed += job_exit_status(job) != 0;
+                remove_job(job);
+                continue;
+            }
+            for (i = 0; slots[i]; i++);
+            slots[i] = job;
+            running++;
+        }
+        if (running == 0) {
+            break;
+        }
+
+        /* children are reaped by the event loop, then free the slots */
+        event_wait(-1, -1);
+        for (i = 0; i < (size_t) max; i++) {
+            if (slots[i] && job_completed(slots[i])) {
+                failed += job_exit_status(slots[i]) != 0;
+                remove_job(slots[i]);
+                slots[i] = NULL;
+                running--;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    fprintf(stderr, "parallel: %zu jobs, %zu failed in %.3fs (%.1f jobs/s, -j %ld)\n",
+            started, failed, seconds, seconds > 0 ? started / seconds : 0.0, max);
+
+    free(slots);
+    release_arena(arena);
+    release_command_line(input);
+    return failed ? 1 : 0;
+}
+
+/* The job whose pgid, or the pid of one of whose processes, is id */
+static job* find_job_id(int id) {
+    job* j = find_job(id);
+    return j ? j : find_job_by_pid(id);
+}
+
+int builtin_wait(process* proc) {
+    job** targets;
+    size_t i, ntargets = 0;
+    bool any = false;
+    double timeout = -1;
+    struct timespec begin, now;
+    int status = 0;
+    job* j;
+
+    /* a forked child (wait | cat) has no children of the shell to wait for */
+    if (getpid() != shell_pid) {
+        return 0;
     }
+
+    /* wait [-n] [id...] [-t seconds] */
+    targets = malloc((proc->argc + jobs_table.number_jobs) * sizeof(*targets));
+    for (i = 1; i < proc->argc; i++) {
+        const char* arg = proc->argv[i];
+        if (strcmp(arg, "-n") == 0) {
+            any = true;
+        } else if (strcmp(arg, "-t") == 0 && i + 1 < proc->argc) {
+            timeout = atof(proc->argv[++i]);
+        } else if (!(j = find_job_id(atoi(arg))) || atoi(arg) <= 0) {
+            fprintf(stderr, "wait: %s: no such job\n", arg);
+            status = 127;
+        } else {
+            size_t k;
+            for (k = 0; k < ntargets && targets[k] != j; k++);
+            if (k == ntargets) { /* a pgid and a pid of the same job are one target */
+                targets[ntargets++] = j;
+            }
+        }
+    }
+    if (ntargets == 0 && status == 0) {
+        /* every background job, but the stopped ones would never end */
+        for (j = jobs_table.first; j; j = j->next) {
+            if (j->background && (job_completed(j) || !job_stopped(j))) {
+                targets[ntargets++] = j;
+            }
+        }
+        if (ntargets == 0) {
+            free(targets);
+            return any ? 127 : 0;
+        }
+    }
+
+    /* sleep in the event loop: the pidfds of the processes wake it */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    while (ntargets > 0) {
+        size_t done = 0;
+        int wait_ms = -1;
+
+        for (i = 0; i < ntargets; i++) {
+            done += job_completed(targets[i]);
+        }
+        if (done == ntargets || (any && done > 0)) {
+            break;
+        }
+        if (timeout >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            wait_ms = (int) ((timeout - (now.tv_sec - begin.tv_sec) - (now.tv_nsec - begin.tv_nsec) / 1e9) * 1000);
+            if (wait_ms <= 0) {
+                free(targets);
+                return 124; /* like timeout(1) */
+            }
+        }
+        if (event_wait(-1, wait_ms) < 0) {
+            break;
+        }
+    }
+
+    /* the status of the (last) job waited for, which is then forgotten */
+    for (i = 0; i < ntargets; i++) {
+        j = targets[i];
+        if (job_completed(j)) {
+            if (status != 127) {
+                status = job_exit_status(j);
+            }
+            if (j->timed && !j->reported) {
+                print_job_usage(j, stderr);
+            }
+            remove_job(j);
+            if (any) {
+                break;
+            }
+        }
+    }
+    free(targets);
+    return status;
+}
+
+int builtin_exit(process* proc) {
+    exit_requested = true;
+    return proc->argc > 1 ? atoi(proc->argv[1]) : last_status;
 }
 
 /***************************************************************
@@ -238,7 +711,7 @@ void builtin_help_cd() {
 }
 
 void builtin_help_jobs() {
-    printf("jobs\t\tDisplay status of jobs in the current session.\n");
+    printf("jobs [-v]\tDisplay status (and -v resource usage) of jobs in the current session.\n");
 }
 
 void builtin_help_fg() {
@@ -249,6 +722,34 @@ void builtin_help_bg() {
     printf("bg <pgid>\tRun jobs in the background.\n");
 }
 
+void builtin_help_hash() {
+    printf("hash [-r] [name]\tShow, reset (-r) or fill the command lookup cache.\n");
+}
+
+void builtin_help_parallel() {
+    printf("parallel [-j N] [file]\tRun each line of file (or stdin) as a job, N at a time (default: CPUs).\n");
+}
+
+void builtin_help_wait() {
+    printf("wait [-n] [id...] [-t seconds]\tWait for background jobs (pgid or pid, all by default) or any of them (-n), return its status.\n");
+}
+
+void builtin_help_time() {
+    printf("time <pipeline>\tRun the pipeline and report time and resources used by each command.\n");
+}
+
+void builtin_help_timeout() {
+    printf("timeout [-k grace] duration <pipeline>\tSIGTERM the pipeline after duration (s, m, h or d), SIGKILL it grace later (default: %gs).\n", TIMEOUT_KILL_AFTER);
+}
+
+void builtin_help_limit() {
+    printf("limit [-c cpu%%] [-m memory] [-p pids] <pipeline>\tRun the pipeline in a cgroup with these cpu.max, memory.max and pids.max (%s).\n", CGROUP_ENV);
+}
+
+void builtin_help_pin() {
+    printf("pin [-s] {-n node | cpu-list} <pipeline>\tRun the pipeline on these CPUs or NUMA node, one CPU per command with -s.\n");
+}
+
 void builtin_help_exit() {
-    printf("exit\t\tCause the shell to exit.\n");
+    printf("exit [n]\tCause the shell to exit (with status n).\n");
 }
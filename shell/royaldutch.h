@@ -26,14 +26,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define PROMPT "RoyalDutch$"
 
+/* Completed background jobs the shell keeps for wait, the oldest go first */
+#define WAIT_REMEMBERED 1024
+
 
 /*****************************
  * Globals
  *****************************/
-/* List of child jobs */
-extern job* jobs_head;
+/* Memory for parsing the current command line, reset on every prompt */
+extern arena_t* line_arena;
 
-/* Can interact with user */
+/* Can interact with user (interactive shell on a terminal) */
 extern bool on_terminal;
 
 /* File descriptor for shell stdin */
@@ -45,11 +48,32 @@ extern int shell_pgid;
 /* Shell IO modes */
 extern struct termios io_flags;
 
+/* Exit status of the last foreground job ($?) */
+extern int last_status;
+
+/* Pid of the shell ($$), kept by the processes it forks */
+extern pid_t shell_pid;
+
+/* Pid of the last process of the last background job ($!), 0 if none */
+extern pid_t last_background;
+
+/* The command lines the shell runs, NULL until main() reads them */
+extern buffer_t* shell_input;
+
+/* The exit builtin was run, the shell stops after the current job */
+extern bool exit_requested;
+
 /******************************
  * Shell functions
  ******************************/
-/* Initialize the shell globals */
-void shell_init();
+/* Initialize the shell globals, job control is only
+ * set up when interactive and stdin is a terminal */
+void shell_init(bool interactive);
+
+/* The shell input when proc, a builtin run by the shell itself, reads
+ * it on its standard input, NULL otherwise: the builtin must take the
+ * bytes the shell read ahead first (command_line_getc()) */
+buffer_t* builtin_shell_input(process* proc);
 
 /* Release the shell globals */
 void shell_release();
@@ -60,38 +84,68 @@ void print_error(char* message);
 /* Gets the name of the last folder in hierarchy */
 char* last_dir(char* path);
 
-/* Prompt user for commands */
-int prompt(buffer_t* buffer, struct job** job);
+/* Print the prompt */
+void show_prompt();
+
+/* Prompt user for a command line and parse it into list, NULL if it
+ * is empty or wrong. Return what read_command_line() returned. */
+int prompt(buffer_t* buffer, pipeline_t** list);
+
+/* Run a pipeline as a job, in foreground or background */
+void run_pipeline(pipeline_t* pipeline);
+
+/* Run the pipelines of a list in order, skipping the ones ruled out by
+ * their && or || connector and the exit status of the previous one */
+void run_list(pipeline_t* list);
 
 /* Set child as foreground process and wait for it to finish */
 void wait_foreground_job(struct job* job);
 
-/* Update status about background process and notifies the user */
+/* Update status about background process and notifies the user.
+ * Completed jobs are removed, but a script keeps them for wait. */
 void notify_background_jobs();
 
+/* Event loop handler of the pidfd of a running process (data): collect
+ * its exit and, if the shell is idle at the prompt, tell the user */
+void process_event(int fd, void* data);
+
 /* Set handler value to SIGINT, SIGQUIT, SIGTTIN, SIGTTOU
  * and override SIGTSTP if needed */
 void set_signals(__sighandler_t handler, bool override_sigtstp);
 
-/* Default shell SIGTSTP (^Z) handler
+/* Default shell SIGTSTP (^Z) handler, run from the event loop
  * propagate the signal to lastest running job */
 void sigtstp_handler(int signo);
 
 /**************************************************
- * Built-in functions
+ * Built-in functions (see builtin.h)
+ **
+ ** Run with the process arguments, return the exit status
  **************************************************/
 
 /** Move the working directory */
-void builtin_cd(struct job* job);
+int builtin_cd(process* proc);
 
 /** List current jobs */
-void builtin_jobs(struct job* job);
+int builtin_jobs(process* proc);
 
 /** Resume stopped job on foreground */
-void builtin_fg(struct job* job);
+int builtin_fg(process* proc);
 
 /** Resume stopped job on background */
-void builtin_bg(struct job* job);
+int builtin_bg(process* proc);
+
+/** Show or reset the command lookup cache */
+int builtin_hash(process* proc);
+
+/** Run the command lines of a file or stdin as jobs, at most N at once */
+int builtin_parallel(process* proc);
+
+/** Wait for background jobs to finish */
+int builtin_wait(process* proc);
+
+/** Stop the shell after this job */
+int builtin_exit(process* proc);
 
 /**************************************************
  * Built-in help functions
@@ -102,6 +156,13 @@ void builtin_help_cd();
 void builtin_help_jobs();
 void builtin_help_fg();
 void builtin_help_bg();
+void builtin_help_hash();
+void builtin_help_parallel();
+void builtin_help_wait();
+void builtin_help_time();
+void builtin_help_timeout();
+void builtin_help_limit();
+void builtin_help_pin();
 void builtin_help_exit();
 
 #endif
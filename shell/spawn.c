@@ -0,0 +1,308 @@
+/* spawn.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+#include "cmdhash.h"
+#include "royaldutch.h"
+#include "event.h"
+#include "vars.h"
+#include "zygote.h"
+#include "cgroup.h"
+#include "affinity.h"
+#include "priority.h"
+
+/* In a forked child: join the job cgroup and process group, take the
+ * terminal and move to the process descriptors. Return 0, or the errno
+ * of the placement that could not be applied, the child must not run. */
+static int setup_child(struct job* job, process* proc, int in_file, int out_file) {
+    int nice, error = 0;
+
+    if (job->background && priority_background(&nice)) {
+        priority_set(0, true, nice);
+    }
+    /* before exec, whatever it starts is accounted; a job with limits
+     * must not run outside of them */
+    if (!cgroup_attach(job->cgroup, 0) && job->cgroup >= 0 && job_limited(job)) {
+        fprintf(stderr, "limit: cannot join the job cgroup: %s\n", strerror(errno));
+        error = EPERM; /* the errno of the file would read as a missing program */
+    }
+    if (proc->cpus && !affinity_pin(proc->cpus) && !error) {
+        error = errno;
+    }
+    if (on_terminal) {
+        pid_t pid = getpid();
+        if (job->pgid == 0) {
+            job->pgid = pid; /*NOTE: remember this is the child process, it doesn't change the value in the parent*/
+        }
+        setpgid(pid, job->pgid); /* move to the appropriate process group (maybe become leader) */
+        if (!job->background && job->procs == proc) { /* this is first process and the job is on foreground */
+            tcsetpgrp(shell_in, job->pgid); /* move it foreground*/
+        }
+        set_signals(SIG_DFL, true);   /* Reset signals the shell is ignoring */
+    }
+
+    if (in_file != STDIN_FILENO) {
+        /* Redirect input */
+        dup2(in_file, STDIN_FILENO);
+    }
+
+    if (out_file != STDOUT_FILENO) {
+        /* Redirect output */
+        dup2(out_file, STDOUT_FILENO);
+    }
+
+    if (job->err != STDERR_FILENO) {
+        /* Redirect error */
+        dup2(job->err, STDERR_FILENO);
+    }
+    return error;
+}
+
+char** script_argv(const char* path, char* const* argv) {
+    size_t argc;
+    char** script;
+
+    for (argc = 0; argv[argc]; argc++);
+    script = malloc((argc + 2) * sizeof(*script));
+    script[0] = "sh";
+    script[1] = (char*) path;
+    memcpy(script + 2, argv + 1, argc * sizeof(*script)); /* with the NULL */
+    return script;
+}
+
+pid_t spawn_builtin(struct job* job, process* proc, const builtin* b, int in_file, int out_file) {
+    pid_t pid;
+
+    /* or the child would write what the shell buffered too */
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if (pid == 0) {
+        int status, error = setup_child(job, proc, in_file, out_file);
+        if (error) {
+            fprintf(stderr, "%s: %s\n", proc->argv[0], strerror(error));
+            _exit(126);
+        }
+        event_after_fork();
+        var_assign(proc->assigns, proc->nassigns, NULL);
+        status = b->run(proc);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status & 0xff);
+    }
+    if (pid > 0 && on_terminal) {
+        setpgid(pid, job->pgid == 0 ? pid : job->pgid);
+    }
+    return pid;
+}
+
+#ifndef LAUNCH_FORK
+
+static pid_t spawn_posix(struct job* job, process* proc, int in_file, int out_file) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    struct sched_param param = {0};
+    sigset_t mask;
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    int nice;
+    pid_t pid;
+    int ret;
+    char** envp;
+    const char* path = cmdhash_lookup(proc->argv[0]);
+
+    if (!path) {
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if (on_terminal) {
+        /* join the job group (pgid 0 makes this process the leader) */
+        flags |= POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+        posix_spawnattr_setpgroup(&attr, job->pgid);
+
+        /* reset the signals the shell is ignoring, see set_signals() */
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGQUIT);
+        sigaddset(&mask, SIGTTIN);
+        sigaddset(&mask, SIGTTOU);
+        sigaddset(&mask, SIGTSTP);
+        posix_spawnattr_setsigdefault(&attr, &mask);
+
+        if (!job->background && job->procs == proc) {
+            /* first process of a foreground job takes the terminal */
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, shell_in);
+        }
+    }
+    if (job->background && priority_background(&nice)) {
+        /* the nice value and I/O priority are set by launch_job() */
+        flags |= POSIX_SPAWN_SETSCHEDULER;
+        posix_spawnattr_setschedpolicy(&attr, SCHED_BATCH);
+        posix_spawnattr_setschedparam(&attr, &param);
+    }
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, flags);
+
+    /* shell descriptors are close-on-exec, dup2 clears the flag on the copy */
+    if (in_file != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, in_file, STDIN_FILENO);
+    }
+    if (out_file != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, out_file, STDOUT_FILENO);
+    }
+    if (job->err != STDERR_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, job->err, STDERR_FILENO);
+    }
+
+    /* exec failures are reported here, the child never runs the program */
+    envp = proc->nassigns ? var_environ_with(proc->assigns, proc->nassigns) : var_environ();
+    /* posix_spawn has no affinity attribute, the child inherits the one
+     * the shell takes for the time of the call */
+    ret = 0;
+    if (proc->cpus && !affinity_pin(proc->cpus)) {
+        ret = errno;
+    }
+    if (ret == 0) {
+        ret = posix_spawn(&pid, path, &actions, &attr, proc->argv, envp);
+    }
+    if (ret == ENOEXEC) {
+        /* a script without #!, run by sh like execvp() does */
+        char** script = script_argv(path, proc->argv);
+        ret = posix_spawn(&pid, SCRIPT_SHELL, &actions, &attr, script, envp);
+        free(script);
+    }
+    if (proc->cpus) {
+        affinity_unpin();
+    }
+    if (proc->nassigns) {
+        free(envp);
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    return pid;
+}
+
+#endif
+
+/* fork()+exec, the child sets itself up before exec */
+static pid_t spawn_fork(struct job* job, process* proc, int in_file, int out_file) {
+    int errpipe[2];
+    int err;
+    ssize_t n;
+    pid_t pid;
+    char** envp;
+    const char* path = cmdhash_lookup(proc->argv[0]);
+
+    if (!path) {
+        return -1;
+    }
+    envp = proc->nassigns ? var_environ_with(proc->assigns, proc->nassigns) : var_environ();
+
+    /* The child writes errno here if execv fails, a successful exec
+     * closes the pipe (O_CLOEXEC) and the parent reads EOF */
+    if (pipe2(errpipe, O_CLOEXEC) < 0) {
+        if (proc->nassigns) {
+            free(envp);
+        }
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        /* Child */
+        close(errpipe[0]);
+        err = setup_child(job, proc, in_file, out_file);
+        if (err == 0) {
+            execve(path, proc->argv, envp);
+            err = errno;
+        }
+        if (err == ENOEXEC) {
+            execve(SCRIPT_SHELL, script_argv(path, proc->argv), envp);
+            err = errno;
+        }
+        while (write(errpipe[1], &err, sizeof(err)) < 0 && errno == EINTR);
+        _exit(127);
+    }
+
+    /* Parent */
+    close(errpipe[1]);
+    if (proc->nassigns) {
+        free(envp);
+    }
+    if (pid == -1) {
+        close(errpipe[0]);
+        return -1;
+    }
+    if (on_terminal) {
+        setpgid(pid, job->pgid == 0 ? pid : job->pgid);
+    }
+
+    do {
+        n = read(errpipe[0], &err, sizeof(err));
+    } while (n < 0 && errno == EINTR);
+    close(errpipe[0]);
+
+    if (n == sizeof(err)) {
+        /* exec failed: collect the child so it never shows up as a job status */
+        waitpid(pid, NULL, 0);
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t spawn_process(struct job* job, process* proc, int in_file, int out_file) {
+    if (job->cgroup >= 0) {
+        /* only a forked child can join the cgroup before exec, or what
+         * the program starts right away could escape it */
+        return spawn_fork(job, proc, in_file, out_file);
+    }
+    if (zygote_running() && !proc->cpus) { /* the zygote keeps its own CPUs */
+        pid_t pid = zygote_spawn(job, proc, in_file, out_file);
+        if (pid != -1 || zygote_running()) {
+            return pid;
+        }
+        /* the zygote is gone, the shell forks from now on */
+    }
+#ifndef LAUNCH_FORK
+    return spawn_posix(job, proc, in_file, out_file);
+#else
+    return spawn_fork(job, proc, in_file, out_file);
+#endif
+}
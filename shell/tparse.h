@@ -22,10 +22,7 @@
 #ifndef TPARSE_H
 #define TPARSE_H
 
-#define MAX_COMMANDS  512  /* Number of commands in a pipeline. */
-#define MAX_ARGUMENTS 512  /* Number of arguments per command in a pipeline. */
-
-#define MAX_FILENAME 1024  /* Maximum length of a filename IO redirection).*/
+#include "arena.h"
 
 /* Struct to read the command line. */
 
@@ -34,59 +31,152 @@ typedef struct buffer_t
   int size;			/* Current buffer size. */
   int length;			/* Current string lenght. */
   char *buffer;			/* String. */
+  int fd;			/* Descriptor lines are read from. */
+  char *ahead;			/* Input read past the current line. */
+  int ahead_start;		/* Offset of the first unused byte in ahead. */
+  int ahead_end;		/* Offset past the last unused byte in ahead. */
+  char *text;			/* Lines read in place, NULL to read from fd. */
+  size_t text_size;		/* Size of text. */
+  size_t text_pos;		/* Offset of the next line in text. */
+  size_t mapped;		/* Bytes of text to munmap, 0 if not mapped. */
 } buffer_t;
 
+#define READ_AHEAD (64*1024)	/* Bytes requested from each read(). */
+
 /* Return a pointer to a newly allocated and properly initialized 
    buffer_t block or NULL on error. */
 
 buffer_t * new_command_line (void);
 
+/* Return a buffer_t block whose lines are the size bytes at text.
+   Lines are not copied: each newline is overwritten with '\0' and
+   the buffer field points into text, so text[size] must be writable. */
+
+buffer_t * new_command_text (char *text, size_t size);
+
+/* Return a buffer_t block reading the lines of the file at path, which
+   is memory mapped and parsed in place, or NULL on error. */
+
+buffer_t * new_command_file (const char *path);
+
 /* Release all the memory used by a buffer_t block. */
 
 void release_command_line (buffer_t *);
 
-/* Read a line from STDIN into a buffer_t block. The buffer
-   grows as needed in steps of BUFFER_STEP bytes. Buffer does not
-   shrinks autmatically.*/
+/* Read a line from STDIN into a buffer_t block, without the newline.
+   Input is read READ_AHEAD bytes at a time and what follows the line
+   is kept for the next call. The buffer doubles as needed and does
+   not shrink automatically. Return the length of the line including
+   its newline (so 1 for an empty line), 0 at end of input or -1 on
+   error. */
 
 int read_command_line (buffer_t *); 
 
+/* Return true if input for the next read_command_line() is already
+   buffered, i.e. it will not wait for the descriptor. */
+
+int command_line_pending (buffer_t *);
+
+/* Return the next input byte of a command_line that reads a descriptor,
+   for commands that read the shell input themselves: the bytes read
+   ahead come first, then the descriptor is read one byte at a time so
+   that nothing past what is asked for is consumed. Return -1 at end of
+   input or on error. */
+
+int command_line_getc (buffer_t *);
+
+/* Move the input read ahead by FROM to TO, a new command_line reading
+   the same descriptor, which then reads it first. */
+
+void command_line_transfer (buffer_t *from, buffer_t *to);
+
 #define FOREGROUND 0		/* Run in foregroud. */
 #define BACKGROUND 1		/* Run in background. */
 
-/* Struct representing a pipeline. */
+/* A word of the command line: its offset and length in the line,
+   quotes and escapes included. Nothing is copied by the parser. */
+
+typedef struct word_t
+{
+  int offset;			/* Offset of the first character. */
+  int length;			/* Number of characters. */
+} word_t;
+
+/* Struct representing a command of a pipeline. */
+
+typedef struct command_t
+{
+  int nwords;			/* Number of words, command name included. */
+  word_t *words;		/* The words. */
+} command_t;
+
+#define REDIRECT_READ   0	/* < file */
+#define REDIRECT_WRITE  1	/* > file */
+#define REDIRECT_APPEND 2	/* >> file */
+#define REDIRECT_HEREDOC 3	/* <<delimiter, the lines up to delimiter */
+#define REDIRECT_HERESTRING 4	/* <<< word, the word and a newline */
+
+/* Struct representing an IO redirection. */
+
+typedef struct redirect_t
+{
+  struct redirect_t *next;	/* Next redirection, in command line order. */
+  int fd;			/* Redirected descriptor: 0, 1 or 2. */
+  int mode;			/* One of REDIRECT_READ, _WRITE, _APPEND. */
+  word_t file;			/* Target file name, here-string or delimiter. */
+  const char *here;		/* Here-document text, read past the line. */
+  int here_length;		/* Length of the here-document text. */
+  int here_expand;		/* Expand $ in the text (delimiter unquoted). */
+} redirect_t;
+
+#define LIST_SEQ 0		/* Follows ';', '&' or is first: always run. */
+#define LIST_AND 1		/* Follows '&&': run if the last status is 0. */
+#define LIST_OR  2		/* Follows '||': run if the last status is not 0. */
+
+/* Struct representing a pipeline, an element of a command list. */
 
 typedef struct pipeline_t
 {
-  char ***command;		/* Command line (grows unboundedly). */
-  char file_in[MAX_FILENAME];	/* Redirect input from this file. */
-  char file_out[MAX_FILENAME];	/* Redirect output to this file. */
-  int ground;			/* Either FOREGROUND or BACKGROUND. */
+  arena_t *arena;		/* Where the pipeline memory comes from. */
+  const char *line;		/* Command line the words refer to. */
+  word_t text;			/* The pipeline itself in line. */
+  command_t *command;		/* Commands (grows unboundedly). */
   int ncommands;		/* Number of commands */
-  int narguments[MAX_COMMANDS];	/* Number of arguments in each command. */
+  redirect_t *redirect;		/* IO redirections, NULL if none. */
+  int ground;			/* Either FOREGROUND or BACKGROUND. */
+  int connector;		/* LIST_SEQ, LIST_AND or LIST_OR. */
+  struct pipeline_t *group;	/* List of a { ...; } group, then no commands. */
+  struct pipeline_t *next;	/* Next element of the list, NULL if last. */
 } pipeline_t;
 
 
-/* Return a pointer to a newly allocated and properly initialized
-   pipeline_t block, or NULL on error.*/
+/* Return a pointer to a properly initialized pipeline_t block
+   allocated from arena, or NULL on error. The pipeline and everything
+   the parser stores in it are released by resetting the arena. */
 
-pipeline_t *new_pipeline (void);
+pipeline_t *new_pipeline (arena_t *arena);
 
-/* Release memory used by a pipeline_t block. */
+/* Parse a command line stored in a buffer_t struct into the list that
+   starts with the target pipeline_t struct: pipelines separated by
+   ';', '&', '&&' or '||', and { ...; } groups of them. The line is
+   scanned once and is not modified; words may be quoted with '' or ""
+   and characters escaped with a backslash. The lines of the <<
+   here-documents are then read from the buffer_t (the line itself is
+   copied to the arena first, as reading reuses the buffer). Return 0
+   on success; on error, or for an empty line, the target has no
+   commands, group nor next element. */
 
-void release_pipeline (pipeline_t *);
+int parse_command_line (buffer_t*, pipeline_t*);
 
-/* Parse a command line stored in a buffer_t struct and fill in the
-   corresponding fields of the target pipeline_t struct. */
+/* Copy a word of line to dst without its quotes and escapes and return
+   the resulting length (at most word.length). dst is not terminated. */
 
-int parse_command_line (buffer_t*, pipeline_t*);
+int unquote_word (const char *line, word_t word, char *dst);
 
 /* Handy macros to check execution mode. */
 
 #define RUN_FOREGROUND(pipeline) (pipeline->ground == FOREGROUND)
 #define RUN_BACKGROUND(pipeline) (pipeline->ground == BACKGROUND)
-#define REDIRECT_STDIN(pipeline) (pipeline->file_in[0] != '\0')
-#define REDIRECT_STDOUT(pipeline) (pipeline->file_out[0] != '\0')
 
 /* Output information of pipeline for debugging purposes. */
 
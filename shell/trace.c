@@ -0,0 +1,130 @@
+/* trace.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* A finished span */
+typedef struct {
+    const char* name;
+    uint64_t start, end;
+    long arg;
+    char detail[32];
+} trace_event;
+
+bool trace_enabled;
+
+static trace_event* events;
+static unsigned long events_next; /* Spans ever recorded, the next slot is events_next % TRACE_EVENTS */
+static uint64_t trace_origin;
+
+void trace_init() {
+    if (!getenv(TRACE_ENV) || !*getenv(TRACE_ENV)) {
+        return;
+    }
+    events = malloc(TRACE_EVENTS * sizeof(*events));
+    if (events) {
+        trace_origin = trace_now();
+        trace_enabled = true;
+    }
+}
+
+uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+void trace_span(const char* name, uint64_t start, const char* detail, long arg) {
+    trace_event* event = &events[events_next++ % TRACE_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->end = trace_now();
+    event->arg = arg;
+    event->detail[0] = '\0';
+    if (detail) {
+        strncat(event->detail, detail, sizeof(event->detail) - 1);
+    }
+}
+
+/* Write s as the contents of a JSON string */
+static void write_escaped(FILE* out, const char* s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        } else if ((unsigned char) *s < ' ') {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+}
+
+void trace_release() {
+    const char* path = getenv(TRACE_ENV);
+    unsigned long i, first;
+    FILE* out;
+    long pid = (long) getpid();
+
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = false;
+
+    out = path ? fopen(path, "w") : NULL;
+    if (!out) {
+        perror(path ? path : TRACE_ENV);
+        free(events);
+        return;
+    }
+
+    /* oldest span first: once the ring is full it is the next to be overwritten */
+    first = events_next > TRACE_EVENTS ? events_next - TRACE_EVENTS : 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (i = first; i < events_next; i++) {
+        trace_event* event = &events[i % TRACE_EVENTS];
+        fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+                i == first ? "" : ",", event->name, pid, pid,
+                (event->start - trace_origin) / 1e3, (event->end - event->start) / 1e3);
+        if (event->detail[0] || event->arg >= 0) {
+            fprintf(out, ",\"args\":{");
+            if (event->detail[0]) {
+                fprintf(out, "\"detail\":\"");
+                write_escaped(out, event->detail);
+                fprintf(out, "\"%s", event->arg >= 0 ? "," : "");
+            }
+            if (event->arg >= 0) {
+                fprintf(out, "\"arg\":%ld", event->arg);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    free(events);
+    events = NULL;
+}
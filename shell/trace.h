@@ -0,0 +1,56 @@
+/* trace.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_TRACE_H
+#define IMP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Environment variable naming the file the trace is written to */
+#define TRACE_ENV "ROYALDUTCH_TRACE"
+
+/* Spans kept, older ones are overwritten */
+#define TRACE_EVENTS 65536
+
+/* Tracing is on, only checked by the macros below */
+extern bool trace_enabled;
+
+/* Start tracing if TRACE_ENV is set */
+void trace_init();
+
+/* Write the spans recorded so far as Chrome trace JSON (chrome://tracing,
+ * ui.perfetto.dev) to the TRACE_ENV file and release the buffer */
+void trace_release();
+
+/* Monotonic time in nanoseconds */
+uint64_t trace_now();
+
+/* Record a span from start to now. detail (may be NULL) is copied,
+ * arg is shown with it unless negative */
+void trace_span(const char* name, uint64_t start, const char* detail, long arg);
+
+/* Time of the beginning of a span, 0 when tracing is off */
+#define TRACE_BEGIN() (trace_enabled ? trace_now() : 0)
+
+/* Record the span name started at TRACE_BEGIN() */
+#define TRACE_END(name, start, detail, arg) \
+    do { if (trace_enabled) { trace_span(name, start, detail, arg); } } while (0)
+
+#endif
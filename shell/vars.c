@@ -0,0 +1,236 @@
+/* vars.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vars.h"
+#include "cmdhash.h"
+#include "tparse.h"
+
+extern char** environ;
+
+hashtab* vars_table;
+
+/* envp built from the exported variables, NULL when one changed */
+static char** env_snapshot;
+
+static void release_var(void* value) {
+    shell_var* var = value;
+    free(var->value);
+    free(var);
+}
+
+/* The variable name changed: an exported one makes the snapshot be
+ * rebuilt on next use, PATH makes the commands be searched again */
+static void var_changed(const char* name, bool exported) {
+    if (exported) {
+        free(env_snapshot);
+        env_snapshot = NULL;
+    }
+    if (strcmp(name, "PATH") == 0) {
+        cmdhash_reset();
+    }
+}
+
+void vars_init() {
+    char** env;
+
+    vars_table = new_hashtab(release_var);
+    for (env = environ; *env; env++) {
+        size_t length = strcspn(*env, "=");
+        char* name;
+        if ((*env)[length] != '=' || !var_valid_name(*env, length)) {
+            continue;
+        }
+        name = strndup(*env, length);
+        var_export(name, *env + length + 1);
+        free(name);
+    }
+}
+
+void vars_release() {
+    if (vars_table) {
+        release_hashtab(vars_table);
+        vars_table = NULL;
+    }
+    free(env_snapshot);
+    env_snapshot = NULL;
+}
+
+bool var_valid_name(const char* name, size_t length) {
+    size_t i;
+    if (length == 0 || (name[0] >= '0' && name[0] <= '9')) {
+        return false;
+    }
+    for (i = 0; i < length; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t var_assignment(const char* word) {
+    size_t length = strcspn(word, "=");
+    return word[length] == '=' && var_valid_name(word, length) ? length : 0;
+}
+
+const char* var_get(const char* name) {
+    shell_var* var = vars_table ? hashtab_get(vars_table, name) : NULL;
+    return var ? var->value : NULL;
+}
+
+bool var_set(const char* name, const char* value) {
+    shell_var* var;
+
+    if (!var_valid_name(name, strlen(name))) {
+        return false;
+    }
+    var = hashtab_get(vars_table, name);
+    if (!var) {
+        var = calloc(1, sizeof(*var));
+        hashtab_put(vars_table, name, var);
+    } else if (strcmp(var->value, value) == 0) {
+        return true; /* keep the snapshot */
+    } else {
+        free(var->value);
+    }
+    var->value = stringdup(value);
+    var_changed(name, var->exported);
+    return true;
+}
+
+bool var_export(const char* name, const char* value) {
+    shell_var* var;
+
+    if (!var_set(name, value ? value : var_get(name) ? var_get(name) : "")) {
+        return false;
+    }
+    var = hashtab_get(vars_table, name);
+    if (!var->exported) {
+        var->exported = true;
+        var_changed(name, true);
+    }
+    return true;
+}
+
+bool var_unset(const char* name) {
+    shell_var* var = vars_table ? hashtab_get(vars_table, name) : NULL;
+    if (!var) {
+        return false;
+    }
+    var_changed(name, var->exported);
+    return hashtab_remove(vars_table, name);
+}
+
+void var_assign(char** assigns, size_t nassigns, char** saved) {
+    size_t i;
+    for (i = 0; i < nassigns; i++) {
+        size_t length = strcspn(assigns[i], "=");
+        char* name = strndup(assigns[i], length);
+        if (saved) {
+            const char* old = var_get(name);
+            saved[i] = old ? stringdup(old) : NULL;
+        }
+        var_set(name, assigns[i] + length + 1);
+        free(name);
+    }
+}
+
+void var_restore(char** assigns, size_t nassigns, char** saved) {
+    size_t i;
+    for (i = nassigns; i-- > 0;) { /* backwards, for FOO=1 FOO=2 */
+        char* name = strndup(assigns[i], strcspn(assigns[i], "="));
+        if (saved[i]) {
+            var_set(name, saved[i]);
+            free(saved[i]);
+        } else {
+            var_unset(name);
+        }
+        free(name);
+    }
+}
+
+/* Where the snapshot is being written */
+typedef struct {
+    size_t count, bytes;        /* Exported variables and size of their strings */
+    char** next;                /* Next array slot */
+    char* strings;              /* Next NAME=value string */
+} env_builder;
+
+static void count_exported(hashtab_entry* entry, void* data) {
+    shell_var* var = entry->value;
+    env_builder* builder = data;
+    if (var->exported) {
+        builder->count++;
+        builder->bytes += strlen(entry->key) + strlen(var->value) + 2;
+    }
+}
+
+static void add_exported(hashtab_entry* entry, void* data) {
+    shell_var* var = entry->value;
+    env_builder* builder = data;
+    if (var->exported) {
+        *builder->next++ = builder->strings;
+        builder->strings = stpcpy(builder->strings, entry->key);
+        *builder->strings++ = '=';
+        builder->strings = stpcpy(builder->strings, var->value) + 1;
+    }
+}
+
+char** var_environ() {
+    env_builder builder = {0, 0, NULL, NULL};
+
+    if (env_snapshot) {
+        return env_snapshot;
+    }
+
+    /* the array and its strings in one block */
+    hashtab_foreach(vars_table, count_exported, &builder);
+    env_snapshot = malloc((builder.count + 1) * sizeof(char*) + builder.bytes);
+    builder.next = env_snapshot;
+    builder.strings = (char*) (env_snapshot + builder.count + 1);
+    hashtab_foreach(vars_table, add_exported, &builder);
+    *builder.next = NULL;
+    return env_snapshot;
+}
+
+char** var_environ_with(char** assigns, size_t nassigns) {
+    char** env = var_environ();
+    size_t size, i, j;
+    char** copy;
+
+    for (size = 0; env[size]; size++);
+    copy = malloc((size + nassigns + 1) * sizeof(char*));
+    memcpy(copy, env, (size + 1) * sizeof(char*));
+
+    for (i = 0; i < nassigns; i++) {
+        size_t length = strcspn(assigns[i], "=") + 1;
+        for (j = 0; j < size && strncmp(copy[j], assigns[i], length) != 0; j++);
+        copy[j] = assigns[i];
+        if (j == size) {
+            copy[++size] = NULL;
+        }
+    }
+    return copy;
+}
@@ -0,0 +1,80 @@
+/* vars.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_VARS_H
+#define IMP_VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hashtab.h"
+
+/* Value of a shell variable */
+typedef struct {
+    char* value;                /* Owned copy of the value */
+    bool exported;              /* Passed to the commands the shell runs */
+} shell_var;
+
+/* Name -> shell_var table, exposed for the export builtin */
+extern hashtab* vars_table;
+
+/* Fill the store with the environment the shell was started with,
+ * every variable of it being exported */
+void vars_init();
+
+/* Release the store and the environment snapshot */
+void vars_release();
+
+/* True if the length bytes at name are a variable name */
+bool var_valid_name(const char* name, size_t length);
+
+/* Length of the name of the assignment NAME=value at word, 0 if word
+ * is not an assignment */
+size_t var_assignment(const char* word);
+
+/* Value of the variable name, NULL if it is not set */
+const char* var_get(const char* name);
+
+/* Set the variable name to value, a new variable is local.
+ * Return false if name is not a valid name. */
+bool var_set(const char* name, const char* value);
+
+/* Export the variable name, setting it to value unless value is NULL
+ * (an unset variable is exported as an empty one). Return false if
+ * name is not a valid name. */
+bool var_export(const char* name, const char* value);
+
+/* Remove the variable name, return false if it was not set */
+bool var_unset(const char* name);
+
+/* Set the variables of the NAME=value strings of assigns. When saved is
+ * not NULL it receives the values they replace for var_restore(). */
+void var_assign(char** assigns, size_t nassigns, char** saved);
+
+/* Give back to the variables of assigns the values saved by var_assign() */
+void var_restore(char** assigns, size_t nassigns, char** saved);
+
+/* The exported variables as an envp array. The array is built once and
+ * reused by every spawn until an exported variable changes. */
+char** var_environ();
+
+/* A copy of var_environ() where the NAME=value strings of assigns take
+ * precedence (FOO=bar cmd). Free the array, not the strings. */
+char** var_environ_with(char** assigns, size_t nassigns);
+
+#endif
@@ -0,0 +1,307 @@
+/* zygote.c
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "zygote.h"
+#include "royaldutch.h"
+#include "cmdhash.h"
+#include "vars.h"
+#include "launch.h"
+
+/* Descriptors passed with each request: stdin, stdout, stderr and cwd */
+#define ZYGOTE_FDS 4
+
+/* What the shell asks the zygote to start, followed by size bytes of
+ * strings: the program path, argc arguments and envc environment ones */
+typedef struct {
+    pid_t pgid;                 /* Process group to join, 0 to lead a new one */
+    bool terminal;              /* Take the terminal (foreground job leader) */
+    size_t argc, envc;          /* Number of arguments and environment strings */
+    size_t size;                /* Bytes of strings that follow */
+} zygote_request;
+
+/* What the zygote answers */
+typedef struct {
+    pid_t pid;                  /* The started process, or -1 */
+    int error;                  /* errno of the failed exec, 0 on success */
+} zygote_reply;
+
+/* Shell end of the socket, -1 when there is no zygote */
+static int zygote_fd = -1;
+static pid_t zygote_pid;
+
+/* Read or write exactly size bytes, false on error or end of file */
+static bool transfer(int fd, void* data, size_t size, bool writing) {
+    char* p = data;
+    while (size > 0) {
+        ssize_t n = writing ? send(fd, p, size, MSG_NOSIGNAL) : recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/* In the started process: set it up like setup_child() does and exec */
+static void zygote_child(zygote_request* request, int* fds, const char* path, char** argv, char** envp) {
+    sigset_t none;
+    int i;
+
+    if (on_terminal) {
+        setpgid(0, request->pgid);
+        if (request->terminal) {
+            tcsetpgrp(shell_in, getpgrp());
+        }
+        set_signals(SIG_DFL, true);
+    }
+    signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    for (i = 0; i < 3; i++) {
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+        }
+    }
+    if (fchdir(fds[3]) == 0) {
+        execve(path, argv, envp);
+        if (errno == ENOEXEC) {
+            execve(SCRIPT_SHELL, script_argv(path, argv), envp);
+        }
+    }
+}
+
+/* Serve the requests of the shell until it closes the socket */
+static void zygote_main(int fd) {
+    signal(SIGCHLD, SIG_DFL);
+
+    while (true) {
+        zygote_request request;
+        zygote_reply reply = {-1, 0};
+        char control[CMSG_SPACE(ZYGOTE_FDS * sizeof(int))];
+        struct iovec iov = {&request, sizeof(request)};
+        struct msghdr msg = {0};
+        struct cmsghdr* cmsg;
+        int fds[ZYGOTE_FDS], errpipe[2];
+        char** vector, * strings, * s;
+        size_t i;
+        ssize_t n;
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        do {
+            n = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+        } while (n < 0 && errno == EINTR);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (n != sizeof(request) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+            _exit(0); /* the shell is gone */
+        }
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+        /* the strings, then the argv and envp vectors pointing into them */
+        strings = malloc(request.size);
+        vector = malloc((request.argc + request.envc + 2) * sizeof(char*));
+        if (!transfer(fd, strings, request.size, false)) {
+            _exit(0);
+        }
+        s = strings + strlen(strings) + 1;
+        for (i = 0; i < request.argc + request.envc + 1; i++) {
+            if (i == request.argc) {
+                vector[i] = NULL;
+                continue;
+            }
+            vector[i] = s;
+            s += strlen(s) + 1;
+        }
+        vector[request.argc + request.envc + 1] = NULL;
+
+        /* a sibling of the zygote: a child of the shell */
+        if (pipe2(errpipe, O_CLOEXEC) == 0) {
+            reply.pid = (pid_t) syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+            if (reply.pid == 0) {
+                int err;
+                zygote_child(&request, fds, strings, vector, vector + request.argc + 1);
+                err = errno;
+                while (write(errpipe[1], &err, sizeof(err)) < 0 && errno == EINTR);
+                _exit(127);
+            }
+            reply.error = reply.pid < 0 ? errno : 0;
+            close(errpipe[1]);
+            do {
+                n = read(errpipe[0], &reply.error, sizeof(reply.error));
+            } while (n < 0 && errno == EINTR);
+            close(errpipe[0]);
+        } else {
+            reply.error = errno;
+        }
+
+        for (i = 0; i < ZYGOTE_FDS; i++) {
+            close(fds[i]);
+        }
+        free(vector);
+        free(strings);
+        if (!transfer(fd, &reply, sizeof(reply), true)) {
+            _exit(0);
+        }
+    }
+}
+
+bool zygote_start() {
+    int sv[2];
+
+    if (zygote_fd >= 0) {
+        return true;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    zygote_pid = fork();
+    if (zygote_pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    if (zygote_pid < 0) {
+        close(sv[0]);
+        return false;
+    }
+    zygote_fd = sv[0];
+    return true;
+}
+
+void zygote_stop() {
+    if (zygote_fd < 0) {
+        return;
+    }
+    close(zygote_fd); /* the zygote exits on end of file */
+    zygote_fd = -1;
+    waitpid(zygote_pid, NULL, 0);
+}
+
+bool zygote_running() {
+    return zygote_fd >= 0;
+}
+
+pid_t zygote_spawn(struct job* job, process* proc, int in_file, int out_file) {
+    const char* path = cmdhash_lookup(proc->argv[0]);
+    char** envp;
+    zygote_request request;
+    zygote_reply reply;
+    char control[CMSG_SPACE(ZYGOTE_FDS * sizeof(int))] = {0};
+    struct iovec iov = {&request, sizeof(request)};
+    struct msghdr msg = {0};
+    struct cmsghdr* cmsg;
+    int fds[ZYGOTE_FDS];
+    char* strings, * s;
+    size_t i;
+    bool sent;
+
+    if (!path) {
+        return -1;
+    }
+    fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[3] < 0) {
+        return -1;
+    }
+    envp = proc->nassigns ? var_environ_with(proc->assigns, proc->nassigns) : var_environ();
+
+    request.pgid = job->pgid;
+    request.terminal = on_terminal && !job->background && job->procs == proc;
+    request.argc = proc->argc;
+    request.size = strlen(path) + 1;
+    for (i = 0; i < proc->argc; i++) {
+        request.size += strlen(proc->argv[i]) + 1;
+    }
+    for (request.envc = 0; envp[request.envc]; request.envc++) {
+        request.size += strlen(envp[request.envc]) + 1;
+    }
+    s = strings = malloc(request.size);
+    s = stpcpy(s, path) + 1;
+    for (i = 0; i < proc->argc; i++) {
+        s = stpcpy(s, proc->argv[i]) + 1;
+    }
+    for (i = 0; i < request.envc; i++) {
+        s = stpcpy(s, envp[i]) + 1;
+    }
+    if (proc->nassigns) {
+        free(envp);
+    }
+
+    /* the descriptors as the shell sees them now (a builtin may have
+     * redirected its own), and its working directory */
+    fds[0] = in_file;
+    fds[1] = out_file;
+    fds[2] = job->err;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    sent = sendmsg(zygote_fd, &msg, MSG_NOSIGNAL) == sizeof(request)
+           && transfer(zygote_fd, strings, request.size, true)
+           && transfer(zygote_fd, &reply, sizeof(reply), false);
+    close(fds[3]);
+    free(strings);
+
+    if (!sent) {
+        int err = errno;
+        zygote_stop();
+        errno = err ? err : EPIPE;
+        return -1;
+    }
+    if (reply.error) {
+        /* collect the child so it never shows up as a job status */
+        if (reply.pid > 0) {
+            waitpid(reply.pid, NULL, 0);
+        }
+        errno = reply.error;
+        return -1;
+    }
+    if (on_terminal) {
+        setpgid(reply.pid, job->pgid == 0 ? reply.pid : job->pgid);
+    }
+    return reply.pid;
+}
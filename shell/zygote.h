@@ -0,0 +1,48 @@
+/* zygote.h
+Copyright (c) 2018,
+
+This file is part of RoyalDutchShell.
+RoyalDutchShell is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMP_ZYGOTE_H
+#define IMP_ZYGOTE_H
+
+#include <stdbool.h>
+#include "job.h"
+
+/* Environment variable that turns the zygote on (any non empty value) */
+#define ZYGOTE_ENV "ROYALDUTCH_ZYGOTE"
+
+/* Fork the zygote: a helper forked while the shell is still small, that
+ * forks every later process in its place, so spawning does not slow down
+ * as the shell grows. The processes it starts are children of the shell
+ * (clone(CLONE_PARENT)): they are reaped and controlled as usual.
+ * Return false if it could not be started. */
+bool zygote_start();
+
+/* Stop the zygote, processes are forked by the shell again */
+void zygote_stop();
+
+/* True while processes are started by the zygote */
+bool zygote_running();
+
+/* Like spawn_process(), through the zygote: it receives the program,
+ * argv, envp, the process group and the descriptors (SCM_RIGHTS) of
+ * proc and sends the pid back. If the zygote is gone, it is stopped and
+ * -1 is returned with errno set (zygote_running() is then false). */
+pid_t zygote_spawn(struct job* job, process* proc, int in_file, int out_file);
+
+#endif